@@ -239,6 +239,52 @@ for reg_type in reg_types:
         structs[struct_name] = (struct_name, typeenum, extends, members)
 
 
+# Structures defined by the layer in include/xr_extx_overlay_layer.h rather
+# than by the registry, described the way the registry parse above would have.
+layer_defined_structs = {
+    "XrCompositionLayerLateLatchEXTX" : ("XrCompositionLayerLateLatchEXTX", "XR_TYPE_COMPOSITION_LAYER_LATE_LATCH_EXTX", "XrCompositionLayerQuad", [
+        { "name" : "type", "type" : "POD", "pod_type" : "XrStructureType", "is_const" : False },
+        { "name" : "next", "type" : "void_pointer", "is_const" : True },
+        { "name" : "space", "type" : "POD", "pod_type" : "XrSpace", "is_const" : False },
+        { "name" : "pose", "type" : "xr_simple_struct", "struct_type" : "XrPosef", "is_const" : False },
+    ]),
+    "XrOverlayStaleLayerPolicyInfoEXTX" : ("XrOverlayStaleLayerPolicyInfoEXTX", "XR_TYPE_OVERLAY_STALE_LAYER_POLICY_INFO_EXTX", "XrSessionCreateInfoOverlayEXTX", [
+        { "name" : "type", "type" : "POD", "pod_type" : "XrStructureType", "is_const" : False },
+        { "name" : "next", "type" : "void_pointer", "is_const" : True },
+        { "name" : "policy", "type" : "POD", "pod_type" : "XrOverlayStaleLayerPolicyEXTX", "is_const" : False },
+        { "name" : "staleFrameLimit", "type" : "POD", "pod_type" : "uint32_t", "is_const" : False },
+    ]),
+    "XrOverlaySessionPriorityInfoEXTX" : ("XrOverlaySessionPriorityInfoEXTX", "XR_TYPE_OVERLAY_SESSION_PRIORITY_INFO_EXTX", "XrSessionCreateInfoOverlayEXTX", [
+        { "name" : "type", "type" : "POD", "pod_type" : "XrStructureType", "is_const" : False },
+        { "name" : "next", "type" : "void_pointer", "is_const" : True },
+        { "name" : "importance", "type" : "POD", "pod_type" : "uint32_t", "is_const" : False },
+    ]),
+    "XrOverlayUpdateRateInfoEXTX" : ("XrOverlayUpdateRateInfoEXTX", "XR_TYPE_OVERLAY_UPDATE_RATE_INFO_EXTX", "XrSessionCreateInfoOverlayEXTX,XrFrameEndInfo", [
+        { "name" : "type", "type" : "POD", "pod_type" : "XrStructureType", "is_const" : False },
+        { "name" : "next", "type" : "void_pointer", "is_const" : True },
+        { "name" : "frameInterval", "type" : "POD", "pod_type" : "uint32_t", "is_const" : False },
+    ]),
+    "XrGraphicsBindingCpuEXTX" : ("XrGraphicsBindingCpuEXTX", "XR_TYPE_GRAPHICS_BINDING_CPU_EXTX", "XrSessionCreateInfo", [
+        { "name" : "type", "type" : "POD", "pod_type" : "XrStructureType", "is_const" : False },
+        { "name" : "next", "type" : "void_pointer", "is_const" : True },
+    ]),
+    "XrSwapchainImageDirtyRectsEXTX" : ("XrSwapchainImageDirtyRectsEXTX", "XR_TYPE_SWAPCHAIN_IMAGE_DIRTY_RECTS_EXTX", "XrSwapchainImageReleaseInfo", [
+        { "name" : "type", "type" : "POD", "pod_type" : "XrStructureType", "is_const" : False },
+        { "name" : "next", "type" : "void_pointer", "is_const" : True },
+        { "name" : "rectCount", "type" : "POD", "pod_type" : "uint32_t", "is_const" : False },
+        { "name" : "rects", "type" : "pointer_to_struct_array", "struct_type" : "XrRect2Di", "size" : "rectCount", "member_text" : "const", "is_const" : True },
+    ]),
+}
+
+# Commands implemented by the layer that aren't in the registry; offered by xrGetInstanceProcAddr
+layer_defined_commands = {
+    "xrEnumerateOverlayStatsEXTX" : "OverlaysLayerEnumerateOverlayStatsEXTX",
+    "xrEnumerateFrameTimingsEXTX" : "OverlaysLayerEnumerateFrameTimingsEXTX",
+    "xrDumpFrameTimingsEXTX" : "OverlaysLayerDumpFrameTimingsEXTX",
+}
+
+structs.update(layer_defined_structs)
+
 supported_structs = [
     "XrVector2f",
     "XrVector3f",
@@ -321,7 +367,7 @@ supported_structs = [
     "XrGraphicsRequirementsD3D11KHR",
     "XrSessionCreateInfoOverlayEXTX",
     "XrEventDataMainSessionVisibilityChangedEXTX",
-]
+] + list(layer_defined_structs.keys())
 
 manually_implemented_commands = [
     "xrApplyHapticFeedback",
@@ -518,6 +564,15 @@ in_constructor = {}
 
 in_destroy = {}
 
+# lambda keeping a removed HandleInfo from being freed while it returns true
+retire_in_use = {}
+
+# Main's frame calls recorded in its FrameTimingRing; xrEndFrame is manually implemented
+frame_timing_phase = {
+    "xrWaitFrame" : "XR_FRAME_TIMING_PHASE_WAIT_FRAME_EXTX",
+    "xrBeginFrame" : "XR_FRAME_TIMING_PHASE_BEGIN_FRAME_EXTX",
+}
+
 add_to_handle_struct = {}
 
 
@@ -545,6 +600,8 @@ add_to_handle_struct["XrInstance"] = {
 add_to_handle_struct["XrSession"] = {
     "members" : """
     ID3D11Device*   d3d11Device;
+    SwapchainImageBackend imageBackend = SWAPCHAIN_IMAGE_BACKEND_D3D11;
+    SharedTexturePool::Ptr texturePool;     // overlay D3D11 sessions only
     XrSession localHandle;
     const XrSessionCreateInfo *createInfo = nullptr;
     std::set<OverlaysLayerXrSwapchainHandleInfo::Ptr> childSwapchains;
@@ -576,6 +633,14 @@ after_downchain_main["xrBeginSession"] = """
     }
 """
 
+before_downchain["xrDestroySession"] = """
+    auto mainSession = gMainSessionContext;
+    if(mainSession && (mainSession->session == localHandleStore)) {
+        // Finish overlays' pending copies and runtime releases before the runtime session goes, and let go of Main's device
+        mainSession->imageCopies->Stop();
+    }
+"""
+
 after_downchain_main["xrDestroySession"] = """
     // XXX tell overlay app that session was lost
 
@@ -604,9 +669,13 @@ add_to_handle_struct["XrSwapchain"] = {
     OverlaySwapchain::Ptr overlaySwapchain;             // Swapchain data on Overlay side
     SwapchainCachedData::Ptr mainAsOverlaySwapchain;   // Swapchain data on Main side
     XrSwapchain localHandle;
+    std::atomic<uint32_t> layerSetsReferencing = 0;     // overlay LayerSets Main may submit
+    std::atomic<uint64_t> lastSubmittedFrame = 0;       // Main xrEndFrame number last submitting this
 """,
 }
 
+retire_in_use["XrSwapchain"] = "[info]{ return OverlaysLayerSwapchainInFlight(info); }"
+
 after_downchain_main["xrCreateSwapchain"] = """
     auto info = OverlaysLayerGetHandleInfoFromXrSwapchain(*swapchain));
     info->localHandle = *swapchain;
@@ -627,17 +696,9 @@ after_downchain_main["xrWaitFrame"] = """
 
         mainSession->sessionState.DoCommand(OpenXRCommand::WAIT_FRAME);
 
-        std::unique_lock<std::recursive_mutex> lock(gConnectionsToOverlayByProcessIdMutex);
-        if(!gConnectionsToOverlayByProcessId.empty()) {
-            for(auto& overlayconn: gConnectionsToOverlayByProcessId) {
-                auto conn = overlayconn.second;
-                auto lock = conn->GetLock();
-                if(conn->ctx) {
-                    // XXX if this overlay app's WaitFrameMainAsOverlay is waiting on WaitFrameMain, release it.
-                }
-            }
-        }
-}
+        // Releases any overlay blocked in WaitFrameMainAsOverlay
+        mainSession->sessionState.PublishFrameTick(frameState);
+    }
 """
 
 # XrDebugUtilsMessenger
@@ -1039,6 +1100,21 @@ only_child_handles = [h for h in supported_handles if h != "XrInstance"]
 
 for handle_type in supported_handles:
 
+    # If this handle tracks a set of child HandleInfos (e.g. XrSession's
+    # childSpaces), Destroy() must also Destroy those children, since
+    # destroying the parent destroys them in the runtime as well
+    cascade_destroy = ""
+    for child_type in supported_handles:
+        child_set = f"child{child_type[2:]}s"
+        if (str(handles[child_type][1] or "") == handle_type) and (f" {child_set};" in add_to_handle_struct.get(handle_type, {}).get("members", "")):
+            cascade_destroy += f"""
+            for(auto& child: {child_set}) {{
+                if(child->valid) {{
+                    child->Destroy();
+                }}
+            }}
+"""
+
     # If this handle has a parent handle type (e.g. XrSpace has the
     # parent XrSession), then create members, ctor, and dtor text to track
     # and manage those handles
@@ -1089,6 +1165,16 @@ extern std::unordered_map<{handle_type}, {handle_type}> gActual{handle_type}ToLo
         substitution_source_text = f"""
 std::recursive_mutex gActual{handle_type}ToLocalHandleMutex;
 std::unordered_map<{handle_type}, {handle_type}> gActual{handle_type}ToLocalHandle;
+"""
+        substitution_remove = f"""
+    // Forget the actual handle unless it was already reused for a newer local handle
+    if(it->second->actualHandle != XR_NULL_HANDLE) {{
+        std::unique_lock<std::recursive_mutex> lock(gActual{handle_type}ToLocalHandleMutex);
+        auto actualIt = gActual{handle_type}ToLocalHandle.find(it->second->actualHandle);
+        if((actualIt != gActual{handle_type}ToLocalHandle.end()) && (actualIt->second == handle)) {{
+            gActual{handle_type}ToLocalHandle.erase(actualIt);
+        }}
+    }}
 """
     else:
         substitution_members = ""
@@ -1096,9 +1182,19 @@ std::unordered_map<{handle_type}, {handle_type}> gActual{handle_type}ToLocalHand
         substitution_destroy = ""
         substitution_header_text = ""
         substitution_source_text = ""
+        substitution_remove = ""
+
+    if handle_type in retire_in_use:
+        retire_call = f"""auto info = it->second.get();
+    OverlaysLayerRetire(std::move(it->second), {retire_in_use[handle_type]});"""
+    else:
+        retire_call = "OverlaysLayerRetire(std::move(it->second));"
 
     handle_header_text = f"""
 
+// Number of constructed and not yet destructed {handle_type}HandleInfos, for leak accounting
+extern std::atomic<int64_t> g{layer_name}{handle_type}HandleInfoLiveCount;
+
 struct {layer_name}{handle_type}HandleInfo
 {{
 
@@ -1111,7 +1207,7 @@ struct {layer_name}{handle_type}HandleInfo
     void Destroy() /* For OpenXR's intents.  Not class destructor. */
     {{
         if(valid) {{
-            // XXX also Destroy all child handles
+            {cascade_destroy}
             {in_destroy.get(handle_type, "")}
             downchain.reset();
             {substitution_dtor}
@@ -1128,11 +1224,13 @@ struct {layer_name}{handle_type}HandleInfo
         {parent_ctor_member_init}
         downchain(downchain_)
     {{
+        g{layer_name}{handle_type}HandleInfoLiveCount++;
         {in_constructor.get(handle_type, "")}
     }}
 
     ~{layer_name}{handle_type}HandleInfo()
     {{
+        g{layer_name}{handle_type}HandleInfoLiveCount--;
         if(valid) {{
             {in_destructor.get(handle_type, "")}
             {substitution_destroy}
@@ -1154,12 +1252,18 @@ extern std::recursive_mutex g{layer_name}{handle_type}ToHandleInfoMutex;
 
 void {layer_name}AddHandleInfoFor{handle_type}({handle_type} handle, {layer_name}{handle_type}HandleInfo::Ptr info);
 {layer_name}{handle_type}HandleInfo::Ptr {layer_name}GetHandleInfoFrom{handle_type}({handle_type} handle);
+{layer_name}{handle_type}HandleInfo* {layer_name}BorrowHandleInfoFrom{handle_type}({handle_type} handle);
+#if !defined(NDEBUG)
+void {layer_name}Get{handle_type}LookupCacheStats(uint64_t *hits, uint64_t *misses);
+#endif
 void {layer_name}Remove{handle_type}FromHandleInfoMap({handle_type} handle);
 {substitution_header_text}
 """
 
     handle_source_text = f"""
 
+std::atomic<int64_t> g{layer_name}{handle_type}HandleInfoLiveCount = 0;
+
 std::unordered_map<{handle_type}, {layer_name}{handle_type}HandleInfo::Ptr> g{layer_name}{handle_type}ToHandleInfo;
 std::recursive_mutex g{layer_name}{handle_type}ToHandleInfoMutex;
 
@@ -1182,6 +1286,56 @@ void {layer_name}AddHandleInfoFor{handle_type}({handle_type} handle, {layer_name
     return it->second;
 }}
 
+struct {layer_name}{handle_type}LookupCacheEntry
+{{
+    {handle_type} handle = XR_NULL_HANDLE;
+    {layer_name}{handle_type}HandleInfo* info = nullptr;
+    uint64_t generation = 0;
+}};
+
+// Entries are only trusted while no handle info of any type has been removed since they were filled
+thread_local {layer_name}{handle_type}LookupCacheEntry t{layer_name}{handle_type}LookupCache[{layer_name}LookupCacheSize];
+
+#if !defined(NDEBUG)
+std::atomic<uint64_t> g{layer_name}{handle_type}LookupCacheHits = 0;
+std::atomic<uint64_t> g{layer_name}{handle_type}LookupCacheMisses = 0;
+
+void {layer_name}Get{handle_type}LookupCacheStats(uint64_t *hits, uint64_t *misses)
+{{
+    *hits = g{layer_name}{handle_type}LookupCacheHits;
+    *misses = g{layer_name}{handle_type}LookupCacheMisses;
+}}
+#endif
+
+// could throw if handle not in the map
+// Caller must hold an {layer_name}EpochGuard; the returned pointer is only valid until that guard is released
+{layer_name}{handle_type}HandleInfo* {layer_name}BorrowHandleInfoFrom{handle_type}({handle_type} handle)
+{{
+    uint64_t generation = g{layer_name}HandleInfoRemoveGeneration;
+    auto& entry = t{layer_name}{handle_type}LookupCache[{layer_name}LookupCacheIndex((uint64_t)handle)];
+    if((entry.handle == handle) && (entry.generation == generation)) {{
+#if !defined(NDEBUG)
+        g{layer_name}{handle_type}LookupCacheHits.fetch_add(1, std::memory_order_relaxed);
+#endif
+        return entry.info;
+    }}
+#if !defined(NDEBUG)
+    g{layer_name}{handle_type}LookupCacheMisses.fetch_add(1, std::memory_order_relaxed);
+#endif
+
+    std::unique_lock<std::recursive_mutex> mlock(g{layer_name}{handle_type}ToHandleInfoMutex);
+    auto it = g{layer_name}{handle_type}ToHandleInfo.find(handle);
+    if(it == g{layer_name}{handle_type}ToHandleInfo.end()) {{
+        OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, nullptr,
+            OverlaysLayerNoObjectInfo, fmt("Could not look up info from {handle_type} handle %llX", handle).c_str());
+        throw OverlaysLayerXrException(XR_ERROR_HANDLE_INVALID);
+    }}
+    entry.handle = handle;
+    entry.info = it->second.get();
+    entry.generation = generation;
+    return entry.info;
+}}
+
 void {layer_name}Remove{handle_type}FromHandleInfoMap({handle_type} handle)
 {{
     std::unique_lock<std::recursive_mutex> mlock(g{layer_name}{handle_type}ToHandleInfoMutex);
@@ -1191,6 +1345,11 @@ void {layer_name}Remove{handle_type}FromHandleInfoMap({handle_type} handle)
             OverlaysLayerNoObjectInfo, fmt("Could not look up info from {handle_type} handle %llX", handle).c_str());
         throw OverlaysLayerXrException(XR_ERROR_HANDLE_INVALID);
     }}
+    {substitution_remove}
+    // Invalidate every thread's lookup cache before the info can be retired
+    g{layer_name}HandleInfoRemoveGeneration++;
+    // Borrowers in an epoch may still be using this info, so defer freeing it
+    {retire_call}
     g{layer_name}{handle_type}ToHandleInfo.erase(it);
 }}
 
@@ -1201,6 +1360,38 @@ void {layer_name}Remove{handle_type}FromHandleInfoMap({handle_type} handle)
     header_text += handle_header_text
     source_text += handle_source_text
 
+header_text += f"void {layer_name}LogHandleInfoCounts(XrInstance instance, const char *command);\n"
+
+log_handle_counts_source = f"""
+// Report live HandleInfos and map sizes per handle type; steady growth across overlay reconnects is a leak
+void {layer_name}LogHandleInfoCounts(XrInstance instance, const char *command)
+{{
+    std::string counts;
+"""
+for handle_type in supported_handles:
+    if handle_type in handles_needing_substitution:
+        actual_map_size = f"""
+    {{
+        std::unique_lock<std::recursive_mutex> lock(gActual{handle_type}ToLocalHandleMutex);
+        counts += fmt(", %zu actual", gActual{handle_type}ToLocalHandle.size());
+    }}
+"""
+    else:
+        actual_map_size = ""
+    log_handle_counts_source += f"""
+    {{
+        std::unique_lock<std::recursive_mutex> mlock(g{layer_name}{handle_type}ToHandleInfoMutex);
+        counts += fmt("{handle_type}: %lld live, %zu mapped", (long long)g{layer_name}{handle_type}HandleInfoLiveCount.load(), g{layer_name}{handle_type}ToHandleInfo.size());
+    }}
+    {actual_map_size}
+    counts += "; ";
+"""
+log_handle_counts_source += f"""
+    OverlaysLayerLogMessage(instance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT, command, OverlaysLayerNoObjectInfo, counts.c_str());
+}}
+"""
+source_text += log_handle_counts_source
+
 
 
 # Generate functions for RPC; RPCCallXyz, RPCServeXyz, Serialize, Copyout ----
@@ -1496,6 +1687,11 @@ WaitSwapchainImageRPC = {
             "type" : "POD",
             "pod_type" : "HANDLE",
         },
+        {
+            "name" : "sharedSyncHandle",
+            "type" : "POD",
+            "pod_type" : "HANDLE",
+        },
     ),
     "function" : "OverlaysLayerWaitSwapchainImageMainAsOverlay"
 }
@@ -1519,10 +1715,46 @@ ReleaseSwapchainImageRPC = {
             "type" : "POD",
             "pod_type" : "HANDLE",
         },
+        {
+            "name" : "sharedSyncHandle",
+            "type" : "POD",
+            "pod_type" : "HANDLE",
+        },
     ),
     "function" : "OverlaysLayerReleaseSwapchainImageMainAsOverlay"
 }
 
+ExportSwapchainImagesRPC = {
+    "command_name" : "ExportSwapchainImages",
+    "args" : (
+        {
+            "name" : "swapchain",
+            "type" : "POD",
+            "pod_type" : "XrSwapchain",
+        },
+        {
+            "name" : "handleCapacityInput",
+            "type" : "POD",
+            "pod_type" : "uint32_t",
+        },
+        {
+            "name" : "handleCountOutput",
+            "type" : "pointer_to_pod",
+            "pod_type" : "uint32_t",
+            "is_const" : False
+        },
+        {
+            "name" : "handles",
+            "type" : "fixed_array",
+            "base_type" : "uint64_t",
+            "input_size" : "handleCapacityInput",
+            "output_size" : "handleCountOutput",
+            "is_const" : False
+        },
+    ),
+    "function" : "OverlaysLayerExportSwapchainImagesMainAsOverlay"
+}
+
 EnumerateReferenceSpacesRPC = {
     "command_name" : "EnumerateReferenceSpaces",
     "args" : (
@@ -1896,6 +2128,7 @@ rpcs = (
     AcquireSwapchainImageRPC,
     WaitSwapchainImageRPC,
     ReleaseSwapchainImageRPC,
+    ExportSwapchainImagesRPC,
     SyncActionsAndGetStateRPC,
     CreateActionSpaceFromBindingRPC,
     GetInputSourceLocalizedNameRPC,
@@ -2576,6 +2809,7 @@ void FreeXrStructChain(XrInstance instance, const %(name)s* p, FreeFunc freefunc
             copy_function += "    %(struct_type)s *%(name)s = reinterpret_cast<%(struct_type)s*>(alloc(sizeof(%(struct_type)s) * src->%(size)s));\n" % member
             copy_function += "    memcpy(%(name)s, src->%(name)s, sizeof(%(struct_type)s) * src->%(size)s);\n" % member
             copy_function += "    dst->%(name)s = %(name)s;\n" % member
+            copy_function += "    addOffsetToPointer(&dst->%(name)s);\n" % member
             free_function += "    freefunc(p->%(name)s);\n" % member
         elif member["type"] == "pointer_to_opaque":
             copy_function += "    // XXX opaque %s* %s\n" % (member["opaque_type"], member["name"])
@@ -2878,7 +3112,7 @@ for command_name in [c for c in supported_commands if c not in manually_implemen
             if not is_pointer:
                 restore_preamble += f"""
     auto {parameter_name}Save = {parameter_name};
-    {parameter_name} = {layer_name}GetHandleInfoFrom{parameter_type}({parameter_name})->actualHandle;
+    {parameter_name} = {layer_name}BorrowHandleInfoFrom{parameter_type}({parameter_name})->actualHandle;
 """
                 undo_restore_postscript += f"""
     {parameter_name} = {parameter_name}Save;
@@ -2926,6 +3160,19 @@ for command_name in [c for c in supported_commands if c not in manually_implemen
     else:
         make_and_store_new_local_handle = ""
 
+    if command_name in frame_timing_phase:
+        # Overlays' frame calls are timed as they arrive in Main instead
+        frame_timing_scope = f"""
+        auto mainSessionForTiming = {handle_name}Info->isProxied ? nullptr : gMainSessionContext;
+        FrameTimingScope frameTiming(mainSessionForTiming ? &mainSessionForTiming->frameTimings : nullptr, {frame_timing_phase[command_name]});
+"""
+        downchain_timing_begin = "FrameTimingScope::DownchainBegin();"
+        downchain_timing_end = "FrameTimingScope::DownchainEnd();"
+    else:
+        frame_timing_scope = ""
+        downchain_timing_begin = ""
+        downchain_timing_end = ""
+
     if handle_type in handles_needing_substitution:
         command_for_main_side = f"""
 {command_type} {layer_command}Main(XrInstance parentInstance, {parameter_cdecls})
@@ -2934,7 +3181,8 @@ for command_name in [c for c in supported_commands if c not in manually_implemen
 
     XrResult result = XR_SUCCESS;
 
-    auto {handle_name}Info = {layer_name}GetHandleInfoFrom{handle_type}({handle_name});
+    {layer_name}EpochGuard epochGuard;
+    auto {handle_name}Info = {layer_name}BorrowHandleInfoFrom{handle_type}({handle_name});
 
     // restore the actual handle
     {handle_type} localHandleStore = {handle_name};
@@ -2944,7 +3192,9 @@ for command_name in [c for c in supported_commands if c not in manually_implemen
 
     {before_downchain.get(command_name, "")}
 
+    {downchain_timing_begin}
     result = {handle_name}Info->downchain->{dispatch_command}({parameter_names});
+    {downchain_timing_end}
 
     {undo_restore_postscript}
 
@@ -2994,7 +3244,20 @@ for command_name in [c for c in supported_commands if c not in manually_implemen
         after_downchain_if_success = ""
 
     if command_is_destroy:
-        special_case_postscript = f"    {handle_name}Info->Destroy();\n"
+        # Remove before Destroy() so the actual handle is still known for unmapping
+        if handle_type in handles_needing_substitution:
+            special_case_postscript = f"""
+        if(!isProxied) {{
+            // {layer_command}Overlay removes proxied handles itself
+            {layer_name}Remove{handle_type}HandleInfo({handle_name});
+        }}
+        {handle_name}Info->Destroy();
+"""
+        else:
+            special_case_postscript = f"""
+        {layer_name}Remove{handle_type}HandleInfo({handle_name});
+        {handle_name}Info->Destroy();
+"""
     # elif other special cases
         # special_case_postscript = ...
     else:
@@ -3006,7 +3269,10 @@ for command_name in [c for c in supported_commands if c not in manually_implemen
 {{
     try {{
 
-        auto {handle_name}Info = {layer_name}GetHandleInfoFrom{handle_type}({handle_name});
+        {layer_name}EpochGuard epochGuard;
+        auto {handle_name}Info = {layer_name}BorrowHandleInfoFrom{handle_type}({handle_name});
+
+        {frame_timing_scope}
 
         {call_actual_command}
 
@@ -3063,6 +3329,10 @@ for command_name in unsupported_command_names:
     source_text += "    } else " + f"if (strcmp(name, \"{command_name}\") == 0) " + "{\n"
     source_text += f"        *function = nullptr;\n"
 
+for command_name, layer_command in layer_defined_commands.items():
+    source_text += "    } else " + f"if (strcmp(name, \"{command_name}\") == 0) " + "{\n"
+    source_text += f"        *function = reinterpret_cast<PFN_xrVoidFunction>({layer_command});\n"
+
 source_text += """
     }
 
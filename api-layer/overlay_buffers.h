@@ -0,0 +1,151 @@
+#ifndef _OVERLAY_BUFFERS_H_
+#define _OVERLAY_BUFFERS_H_
+
+// Containers the layer shares between threads, kept free of Windows and
+// graphics API dependencies so they can be tested on any platform.
+
+#include <openxr/openxr.h>
+#include "../include/xr_extx_overlay_layer.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// FIFO of acquired image indices.  Sized once to the swapchain's image count,
+// since no more than that can be acquired at a time.
+struct SwapchainImageIndexRing
+{
+    constexpr static uint32_t noIndex = UINT32_MAX;
+
+    std::vector<uint32_t>   slots;
+    uint32_t                head = 0;
+    uint32_t                count = 0;
+
+    SwapchainImageIndexRing(uint32_t capacity) :
+        slots(capacity)
+    {
+    }
+
+    bool Empty() const { return count == 0; }
+    bool Full() const { return count == slots.size(); }
+    // False if already full
+    bool Push(uint32_t index)
+    {
+        if(Full()) {
+            return false;
+        }
+        slots[(head + count) % slots.size()] = index;
+        count++;
+        return true;
+    }
+    // noIndex if Empty()
+    uint32_t Front() const { return Empty() ? noIndex : slots[head]; }
+    // False if already empty
+    bool Pop()
+    {
+        if(Empty()) {
+            return false;
+        }
+        head = (head + 1) % slots.size();
+        count--;
+        return true;
+    }
+};
+
+// Fixed-size ring of a session's recent frame call timings.  Writers claim a
+// slot with one fetch_add and never block; readers skip slots being rewritten.
+struct FrameTimingRing
+{
+    constexpr static uint32_t recordCount = 1024;
+
+    struct Slot
+    {
+        std::atomic<uint64_t> written = 0;      // record index + 1 once complete, 0 while being written
+        std::atomic<uint32_t> phase = 0;
+        std::atomic<uint64_t> frame = 0;
+        std::atomic<int64_t> start = 0;
+        std::atomic<int64_t> duration = 0;
+        std::atomic<int64_t> downchainDuration = 0;
+    };
+    Slot slots[recordCount];
+    std::atomic<uint64_t> recorded = 0;
+
+    void Record(XrFrameTimingPhaseEXTX phase, uint64_t frame, int64_t start, int64_t duration, int64_t downchainDuration)
+    {
+        uint64_t index = recorded.fetch_add(1);
+        Slot& slot = slots[index % recordCount];
+        slot.written.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.phase.store(phase, std::memory_order_relaxed);
+        slot.frame.store(frame, std::memory_order_relaxed);
+        slot.start.store(start, std::memory_order_relaxed);
+        slot.duration.store(duration, std::memory_order_relaxed);
+        slot.downchainDuration.store(downchainDuration, std::memory_order_relaxed);
+        slot.written.store(index + 1, std::memory_order_release);
+    }
+
+    // Appends the complete records still in the ring, oldest first
+    void Read(uint32_t overlayProcessId, std::vector<XrFrameTimingEXTX>& timings) const
+    {
+        uint64_t end = recorded.load(std::memory_order_acquire);
+        uint64_t begin = (end > recordCount) ? (end - recordCount) : 0;
+        for(uint64_t index = begin; index < end; index++) {
+            const Slot& slot = slots[index % recordCount];
+            XrFrameTimingEXTX timing { XR_TYPE_FRAME_TIMING_EXTX };
+            uint64_t before = slot.written.load(std::memory_order_acquire);
+            timing.overlayProcessId = overlayProcessId;
+            timing.phase = (XrFrameTimingPhaseEXTX)slot.phase.load(std::memory_order_relaxed);
+            timing.frameTickSequence = slot.frame.load(std::memory_order_relaxed);
+            timing.start = slot.start.load(std::memory_order_relaxed);
+            timing.duration = slot.duration.load(std::memory_order_relaxed);
+            timing.downchainDuration = slot.downchainDuration.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if((before == index + 1) && (slot.written.load(std::memory_order_relaxed) == before)) {
+                timings.push_back(timing);
+            }
+        }
+    }
+};
+
+// Single-producer, single-consumer triple buffer.  The writer fills
+// GetWriteBuffer() and calls Publish(); the reader calls AcquireLatest() and
+// gets the most recent complete buffer.  Neither side ever waits on the other.
+template <class T>
+struct TripleBuffer
+{
+    enum {
+        INDEX_MASK = 0x3,
+        FRESH_BIT = 0x4,
+    };
+
+    T buffers[3];
+    uint32_t writeIndex = 0;                // owned by writer
+    uint32_t readIndex = 1;                 // owned by reader
+    std::atomic<uint32_t> latest = 2;       // last published index, FRESH_BIT if reader hasn't taken it
+
+    T& GetWriteBuffer()
+    {
+        return buffers[writeIndex];
+    }
+
+    void Publish()
+    {
+        uint32_t previous = latest.exchange(writeIndex | FRESH_BIT, std::memory_order_acq_rel);
+        writeIndex = previous & INDEX_MASK;
+    }
+
+    // Returns the same buffer as the last call if nothing new was published
+    const T& AcquireLatest(bool *fresh = nullptr)
+    {
+        bool isFresh = (latest.load(std::memory_order_acquire) & FRESH_BIT) != 0;
+        if(isFresh) {
+            uint32_t previous = latest.exchange(readIndex, std::memory_order_acq_rel);
+            readIndex = previous & INDEX_MASK;
+        }
+        if(fresh) {
+            *fresh = isFresh;
+        }
+        return buffers[readIndex];
+    }
+};
+
+#endif // _OVERLAY_BUFFERS_H_
@@ -35,6 +35,7 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cerrno>
 #include <cstring>
 #include <fstream>
 #include <iostream>
@@ -48,6 +49,8 @@
 #include <map>
 #include <vector>
 #include <unordered_set>
+#include <condition_variable>
+#include <chrono>
 
 #include <dxgi1_2.h>
 #include <d3d11_1.h>
@@ -514,11 +517,13 @@ std::vector<PlaceholderActionId> PlaceholderActionIds =
 
 // Just in case everything is terrible and every proc has to be synchronized
 std::recursive_mutex gSynchronizeEveryProcMutex;
-bool gSynchronizeEveryProc = true; // XXX Currently true because of both layer view loss and ReleaseSwapchainImage VALIDATION_FAILURE
+// Main exports its runtime swapchain images to D3D11 overlays when the runtime made them shareable
+bool gZeroCopySwapchains = false;
+uint64_t gSharedTexturePoolBytes = 128ull << 20;
+// Larger OVERLAYS_API_LAYER_TEXTURE_POOL_MB values are clamped to this
+constexpr unsigned long long SharedTexturePoolMaxMB = 64ull << 10;
 
-// LATER understand which lock isn't doing its job and take this out
-// But I'm also using to enforce synchronization between LocateSpace and EndFrame, which seem to conflict
-std::recursive_mutex EndFrameMutex;
+bool gSynchronizeEveryProc = true; // XXX Currently true because of both layer view loss and ReleaseSwapchainImage VALIDATION_FAILURE
 
 // On OVR I get regular deadlocks in one thread in runtime ReleaseSwapchainImage and in another thread in ApplyHapticFeedback.
 std::recursive_mutex HapticQuirkMutex;
@@ -540,6 +545,201 @@ std::unique_lock<std::recursive_mutex> GetSyncActionsLock()
 }
 
 
+// Epoch reclamation for borrowed HandleInfo pointers ------------------------
+
+// Each thread entering a guard claims a slot and publishes the global epoch
+// it entered at; 0 means the slot's thread is not in a guard.  Threads past
+// the slot count fall back to gEpochOverflowReaders, which conservatively
+// holds off all reclamation while any of them is inside a guard.
+constexpr uint32_t EpochReaderSlotCount = 128;
+
+std::atomic<uint64_t> gEpochGlobal = 1;
+std::atomic<uint64_t> gEpochReaderSlots[EpochReaderSlotCount];
+std::atomic<bool> gEpochReaderSlotClaimed[EpochReaderSlotCount];
+std::atomic<uint32_t> gEpochOverflowReaders = 0;
+
+struct RetiredObject
+{
+    uint64_t epoch;
+    std::shared_ptr<void> object;
+    std::function<bool()> inUse;
+};
+
+std::atomic<uint64_t> gOverlaysLayerHandleInfoRemoveGeneration = 1;
+
+std::atomic<int32_t> gOverlaysLayerLiveInstanceCount = 0;
+
+std::mutex gRetiredObjectsMutex;
+std::condition_variable gRetiredObjectsCondition;
+std::vector<RetiredObject> gRetiredObjects;
+
+// How long the reclaimer waits before rechecking when readers are still in old epochs
+constexpr int EpochReclaimRetryMillis = 5;
+
+// How long the last xrDestroyInstance lets the reclaimer wait for readers
+constexpr int EpochReclaimDrainMillis = 1000;
+
+// The reclaimer thread runs from the first retire until the last instance is
+// destroyed; all three are guarded by gRetiredObjectsMutex, except that only
+// OverlaysLayerStopReclaimer joins the thread, while it's still "running"
+std::thread gEpochReclaimerThread;
+bool gEpochReclaimerRunning = false;
+bool gEpochReclaimerStopping = false;
+
+struct EpochReaderSlot
+{
+    int32_t index = -1;
+    uint32_t depth = 0;
+
+    EpochReaderSlot()
+    {
+        for(uint32_t i = 0; i < EpochReaderSlotCount; i++) {
+            bool expected = false;
+            if(gEpochReaderSlotClaimed[i].compare_exchange_strong(expected, true)) {
+                index = i;
+                break;
+            }
+        }
+    }
+
+    ~EpochReaderSlot()
+    {
+        if(index >= 0) {
+            gEpochReaderSlots[index] = 0;
+            gEpochReaderSlotClaimed[index] = false;
+        }
+    }
+};
+
+thread_local EpochReaderSlot tEpochReaderSlot;
+
+// Oldest epoch any thread may still be reading in; objects retired before it are unreachable
+uint64_t OldestActiveEpoch()
+{
+    if(gEpochOverflowReaders > 0) {
+        return 0;
+    }
+    uint64_t oldest = gEpochGlobal;
+    for(uint32_t i = 0; i < EpochReaderSlotCount; i++) {
+        uint64_t epoch = gEpochReaderSlots[i];
+        if((epoch != 0) && (epoch < oldest)) {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+// Frees retired objects in batches so Destroy calls and frame threads never
+// run HandleInfo or connection destructors themselves.  Once stopping, it
+// frees what it can and exits, leaking anything still observed after
+// EpochReclaimDrainMillis rather than running its destructor after the
+// layer is unloaded.
+void EpochReclaimerThreadBody()
+{
+    std::unique_lock<std::mutex> lock(gRetiredObjectsMutex);
+    bool draining = false;
+    std::chrono::steady_clock::time_point drainDeadline;
+
+    while(1) {
+        if(gRetiredObjects.empty()) {
+            gRetiredObjectsCondition.wait(lock, []{ return !gRetiredObjects.empty() || gEpochReclaimerStopping; });
+        } else {
+            gRetiredObjectsCondition.wait_for(lock, std::chrono::milliseconds(EpochReclaimRetryMillis));
+        }
+
+        if(gEpochReclaimerStopping && !draining) {
+            draining = true;
+            drainDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(EpochReclaimDrainMillis);
+        }
+
+        uint64_t oldest = OldestActiveEpoch();
+        auto firstKept = std::partition(gRetiredObjects.begin(), gRetiredObjects.end(), [oldest](const RetiredObject& r){ return (r.epoch < oldest) && !(r.inUse && r.inUse()); });
+        if(firstKept != gRetiredObjects.begin()) {
+            std::vector<RetiredObject> reclaimable(std::make_move_iterator(gRetiredObjects.begin()), std::make_move_iterator(firstKept));
+            gRetiredObjects.erase(gRetiredObjects.begin(), firstKept);
+
+            // Destroy outside the mutex; HandleInfo dtors may call downchain or retire more objects
+            lock.unlock();
+            reclaimable.clear();
+            lock.lock();
+        }
+
+        if(draining) {
+            if(gRetiredObjects.empty()) {
+                break;
+            }
+            if(std::chrono::steady_clock::now() >= drainDeadline) {
+                OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT, "xrDestroyInstance",
+                    OverlaysLayerNoObjectInfo, fmt("leaking %zu retired objects still in use", gRetiredObjects.size()).c_str());
+                new std::vector<RetiredObject>(std::move(gRetiredObjects));
+                gRetiredObjects.clear();
+                break;
+            }
+        }
+    }
+}
+
+OverlaysLayerEpochGuard::OverlaysLayerEpochGuard()
+{
+    auto& slot = tEpochReaderSlot;
+    if(slot.depth++ == 0) {
+        if(slot.index >= 0) {
+            gEpochReaderSlots[slot.index] = gEpochGlobal.load();
+        } else {
+            gEpochOverflowReaders++;
+        }
+    }
+}
+
+OverlaysLayerEpochGuard::~OverlaysLayerEpochGuard()
+{
+    auto& slot = tEpochReaderSlot;
+    if(--slot.depth == 0) {
+        if(slot.index >= 0) {
+            gEpochReaderSlots[slot.index] = 0;
+        } else {
+            gEpochOverflowReaders--;
+        }
+    }
+}
+
+void OverlaysLayerRetire(std::shared_ptr<void> retired, std::function<bool()> inUse)
+{
+    {
+        std::unique_lock<std::mutex> lock(gRetiredObjectsMutex);
+        if(!gEpochReclaimerRunning) {
+            gEpochReclaimerRunning = true;
+            gEpochReclaimerStopping = false;
+            gEpochReclaimerThread = std::thread(EpochReclaimerThreadBody);
+        }
+        // Any reader that sees the incremented epoch entered after the map removal
+        gRetiredObjects.push_back({gEpochGlobal.fetch_add(1), std::move(retired), std::move(inUse)});
+    }
+    gRetiredObjectsCondition.notify_one();
+}
+
+void OverlaysLayerStopReclaimer()
+{
+    {
+        std::unique_lock<std::mutex> lock(gRetiredObjectsMutex);
+        if(!gEpochReclaimerRunning) {
+            return;
+        }
+        gEpochReclaimerStopping = true;
+    }
+    gRetiredObjectsCondition.notify_one();
+    gEpochReclaimerThread.join();
+
+    std::unique_lock<std::mutex> lock(gRetiredObjectsMutex);
+    gEpochReclaimerRunning = false;
+    // Retired while the thread was exiting; as good as leaked by the drain
+    if(!gRetiredObjects.empty()) {
+        new std::vector<RetiredObject>(std::move(gRetiredObjects));
+        gRetiredObjects.clear();
+    }
+}
+
+
 std::string PathToString(XrInstance instance, XrPath path)
 {
     if(path == XR_NULL_PATH) {
@@ -829,196 +1029,1325 @@ static std::map<DXGI_FORMAT, DXGI_FORMAT> TypedFormatToTypelessFormat = {
     // DXGI_FORMAT_FORCE_UINT
 };
 
-bool OverlaySwapchain::CreateTextures(XrInstance instance, ID3D11Device *d3d11, DWORD mainProcessId)
+static void LogWrongSwapchainImageType(XrInstance instance, XrStructureType type, const char* expected)
 {
-    for(int i = 0; i < swapchainTextures.size(); i++) {
-        D3D11_TEXTURE2D_DESC desc;
-        desc.Width = width;
-        desc.Height = height;
-        desc.MipLevels = desc.ArraySize = 1;
-        desc.SampleDesc.Count = 1;
-        desc.SampleDesc.Quality = 0;
-        desc.Usage = D3D11_USAGE_DEFAULT;
-        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = D3D11_RESOURCE_MISC_SHARED_NTHANDLE | D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX;
-
-        if(TypedFormatToTypelessFormat.count(format) > 0) {
-            desc.Format = TypedFormatToTypelessFormat.at(format);
-        } else {
-            desc.Format = format;
-        }
+    OverlaysLayerXrInstanceHandleInfo::Ptr info = OverlaysLayerGetHandleInfoFromXrInstance(instance);
 
-        HRESULT result;
-        if((result = d3d11->CreateTexture2D(&desc, NULL, &swapchainTextures[i])) != S_OK) {
-            LogWindowsError(result, "xrCreateSwapchain", "CreateTexture2D", __FILE__, __LINE__);
-            return false;
-        }
+    char structTypeName[XR_MAX_STRUCTURE_NAME_SIZE];
+    structTypeName[0] = '\0';
+    if(info->downchain->StructureTypeToString(instance, type, structTypeName) != XR_SUCCESS) {
+        sprintf(structTypeName, "<type %08X>", type);
+    }
+    OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrEnumerateSwapchainImages",
+        OverlaysLayerNoObjectInfo, fmt("images structure type is %s and not %s.", structTypeName, expected).c_str());
+}
 
-        {
-            IDXGIResource1* sharedResource = NULL;
-            if((result = swapchainTextures[i]->QueryInterface(__uuidof(IDXGIResource1), (LPVOID*) &sharedResource)) != S_OK) {
-                LogWindowsError(result, "xrCreateSwapchain", "QueryInterface", __FILE__, __LINE__);
-                return false;
-            }
+// Duplicate a handle from this process into Main's so Main can open it
+static bool DuplicateHandleIntoMain(HANDLE handle, HANDLE mainProcessHandle, HANDLE* mainHandle)
+{
+    bool duplicated = DuplicateHandle(GetCurrentProcess(), handle, mainProcessHandle, mainHandle, 0, TRUE, DUPLICATE_SAME_ACCESS);
+    if(!duplicated) {
+        LogWindowsLastError("xrCreateSwapchain", "DuplicateHandle", __FILE__, __LINE__);
+    }
+    return duplicated;
+}
 
-            HANDLE thisProcessHandle = GetCurrentProcess();
-            HANDLE hostProcessHandle;
-            hostProcessHandle = OpenProcess(PROCESS_ALL_ACCESS, TRUE, mainProcessId);
-            if(hostProcessHandle == NULL) {
-                LogWindowsLastError("xrCreateSwapchain", "OpenProcess", __FILE__, __LINE__);
-                return false;
-            }
+void SharedTexturePool::Texture::Free()
+{
+    if(texture) {
+        texture->Release();
+    }
+    if(localHandle) {
+        CloseHandle(localHandle);
+    }
+    *this = Texture();
+}
 
-            HANDLE handle;
+SharedTexturePool::~SharedTexturePool()
+{
+    for(auto& entry: entries) {
+        entry.texture.Free();
+    }
+}
 
-            // Get the Shared Handle for the texture. This is still local to this process but is an actual HANDLE
-            if((result = sharedResource->CreateSharedHandle(NULL,
-                DXGI_SHARED_RESOURCE_READ, // GENERIC_ALL | DXGI_SHARED_RESOURCE_READ | DXGI_SHARED_RESOURCE_WRITE,
-                NULL, &handle)) != S_OK) {
+bool SharedTexturePool::Take(const Key& key, Texture& texture)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = std::find_if(entries.begin(), entries.end(), [&key](const Entry& entry) { return entry.key == key; });
+    if(it == entries.end()) {
+        return false;
+    }
+    texture = it->texture;
+    pooledBytes -= it->bytes;
+    entries.erase(it);
+    return true;
+}
 
-                LogWindowsError(result, "xrCreateSwapchain", "CreateSharedHandle", __FILE__, __LINE__);
-                return false;
-            }
-            
-            // Duplicate the handle so "Host" RPC service process can use it
-            if(!DuplicateHandle(thisProcessHandle, handle, hostProcessHandle, &swapchainHandles[i], 0, TRUE, DUPLICATE_SAME_ACCESS)) {
-                LogWindowsLastError("xrCreateSwapchain", "DuplicateHandle", __FILE__, __LINE__);
-                return false;
-            }
-            CloseHandle(handle);
-            sharedResource->Release();
+void SharedTexturePool::Give(const Key& key, const Texture& texture, uint64_t bytes)
+{
+    std::vector<Texture> evicted;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        entries.push_front(Entry { key, texture, bytes });
+        pooledBytes += bytes;
+        while(pooledBytes > capacityBytes) {
+            evicted.push_back(entries.back().texture);
+            pooledBytes -= entries.back().bytes;
+            entries.pop_back();
         }
     }
+    for(auto& t: evicted) {
+        t.Free();
+    }
+}
+
+bool D3D11OverlaySwapchainImages::CreateTexture(uint32_t index)
+{
+    D3D11_TEXTURE2D_DESC desc;
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = desc.ArraySize = 1;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_SHARED_NTHANDLE | D3D11_RESOURCE_MISC_SHARED;
+
+    if(TypedFormatToTypelessFormat.count(format) > 0) {
+        desc.Format = TypedFormatToTypelessFormat.at(format);
+    } else {
+        desc.Format = format;
+    }
+
+    HRESULT result;
+    if((result = d3d11->CreateTexture2D(&desc, NULL, &textures[index])) != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "CreateTexture2D", __FILE__, __LINE__);
+        return false;
+    }
+
+    IDXGIResource1* sharedResource = NULL;
+    if((result = textures[index]->QueryInterface(__uuidof(IDXGIResource1), (LPVOID*) &sharedResource)) != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "QueryInterface", __FILE__, __LINE__);
+        return false;
+    }
+
+    // Get the Shared Handle for the texture. This is still local to this process but is an actual HANDLE
+    result = sharedResource->CreateSharedHandle(NULL,
+        DXGI_SHARED_RESOURCE_READ, // GENERIC_ALL | DXGI_SHARED_RESOURCE_READ | DXGI_SHARED_RESOURCE_WRITE,
+        NULL, &localHandles[index]);
+    sharedResource->Release();
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "CreateSharedHandle", __FILE__, __LINE__);
+        localHandles[index] = NULL;
+        return false;
+    }
     return true;
 }
 
-OptionalSessionStateChange SessionStateTracker::GetAndDoPendingStateChange(MainSessionSessionState *mainState)
+bool D3D11OverlaySwapchainImages::CreateSharedFence(ID3D11Device5* device5, uint32_t index, HANDLE mainProcessHandle)
 {
-    if((sessionState != XR_SESSION_STATE_LOSS_PENDING) &&
-        ((mainState->GetLossState() == LOST) ||
-        (mainState->GetLossState() == LOSS_PENDING))) {
+    HRESULT result = device5->CreateFence(0, D3D11_FENCE_FLAG_SHARED, __uuidof(ID3D11Fence), (void **)&fences[index]);
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "CreateFence", __FILE__, __LINE__);
+        fences[index] = nullptr;
+        return false;
+    }
 
-        return OptionalSessionStateChange { true, sessionState = XR_SESSION_STATE_LOSS_PENDING };
+    HANDLE localHandle = NULL;
+    result = fences[index]->CreateSharedHandle(NULL, GENERIC_ALL, NULL, &localHandle);
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "CreateSharedHandle", __FILE__, __LINE__);
+        return false;
     }
+    bool duplicated = DuplicateHandleIntoMain(localHandle, mainProcessHandle, &syncHandles[index]);
+    CloseHandle(localHandle);
+    return duplicated;
+}
 
-    switch(sessionState) {
-        case XR_SESSION_STATE_UNKNOWN:
-            if(mainState->sessionState != XR_SESSION_STATE_UNKNOWN) {
-                return OptionalSessionStateChange { true, sessionState = XR_SESSION_STATE_IDLE };
-            }
-            break;
+bool D3D11OverlaySwapchainImages::Create(XrInstance instance, uint32_t count, HANDLE mainProcessHandle)
+{
+    textures.resize(count, nullptr);
+    localHandles.resize(count, NULL);
+    handles.resize(count, NULL);
+    fences.resize(count, nullptr);
+    syncHandles.resize(count, NULL);
+    releaseCounts.resize(count, 0);
+    overlayHolds.resize(count, false);
+
+    // Shared fences need ID3D11Device5 and ID3D11DeviceContext4
+    ID3D11Device5* device5;
+    HRESULT result = d3d11->QueryInterface(__uuidof(ID3D11Device5), (void **)&device5);
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "QueryInterface", __FILE__, __LINE__);
+        return false;
+    }
+    ID3D11DeviceContext* d3d11Context;
+    d3d11->GetImmediateContext(&d3d11Context);
+    result = d3d11Context->QueryInterface(__uuidof(ID3D11DeviceContext4), (void **)&d3d11Context4);
+    d3d11Context->Release();
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "QueryInterface", __FILE__, __LINE__);
+        d3d11Context4 = nullptr;
+        device5->Release();
+        return false;
+    }
 
-        case XR_SESSION_STATE_IDLE:
-            if(exitRequested || (mainState->sessionState == XR_SESSION_STATE_EXITING)) {
-                return OptionalSessionStateChange { true, sessionState = XR_SESSION_STATE_EXITING };
-            } else if(mainState->isRunning && mainState->hasCalledWaitFrame) {
-                return OptionalSessionStateChange { true, sessionState = XR_SESSION_STATE_READY };
-            }
-            break;
+    auto texturePool = pool.lock();
 
-        case XR_SESSION_STATE_READY:
-            if(isRunning) {
-                return OptionalSessionStateChange { true, sessionState = XR_SESSION_STATE_SYNCHRONIZED };
-            } 
+    bool created = true;
+    for(uint32_t i = 0; created && (i < count); i++) {
+        SharedTexturePool::Texture pooled;
+        if(texturePool && texturePool->Take(poolKey, pooled)) {
+            textures[i] = pooled.texture;
+            localHandles[i] = pooled.localHandle;
+        } else if(!CreateTexture(i)) {
+            created = false;
             break;
+        }
 
-        case XR_SESSION_STATE_SYNCHRONIZED:
-            if(exitRequested || !mainState->isRunning || (mainState->sessionState == XR_SESSION_STATE_STOPPING)) {
-                return OptionalSessionStateChange { true, sessionState = XR_SESSION_STATE_STOPPING };
-            } else if((mainState->sessionState == XR_SESSION_STATE_VISIBLE) || (mainState->sessionState == XR_SESSION_STATE_FOCUSED)) {
-                return OptionalSessionStateChange { true, sessionState = XR_SESSION_STATE_VISIBLE };
-            } 
-            break;
+        // Duplicate the handle so "Host" RPC service process can use it; Main closes its copy
+        created = DuplicateHandleIntoMain(localHandles[i], mainProcessHandle, &handles[i]) &&
+            CreateSharedFence(device5, i, mainProcessHandle);
+    }
+    device5->Release();
+    return created;
+}
 
-        case XR_SESSION_STATE_VISIBLE:
-            if(exitRequested || !mainState->isRunning || (mainState->sessionState == XR_SESSION_STATE_STOPPING)) {
-                return OptionalSessionStateChange { true, sessionState = XR_SESSION_STATE_SYNCHRONIZED };
-            } else if(mainState->sessionState == XR_SESSION_STATE_SYNCHRONIZED) {
-                return OptionalSessionStateChange { true, sessionState = XR_SESSION_STATE_SYNCHRONIZED };
-            } else if(mainState->sessionState == XR_SESSION_STATE_FOCUSED) {
-                return OptionalSessionStateChange { true, sessionState = XR_SESSION_STATE_FOCUSED };
-            }
-            break;
+bool D3D11OverlaySwapchainImages::ResetForPool(uint32_t index)
+{
+    // Rendering the overlay does next is already ordered after Main's reads
+    // of an image it holds; otherwise check without waiting
+    if(overlayHolds[index] || (releaseCounts[index] == 0)) {
+        return true;
+    }
+    return fences[index] && (fences[index]->GetCompletedValue() >= 2 * releaseCounts[index]);
+}
 
-        case XR_SESSION_STATE_FOCUSED:
-            if(exitRequested || !mainState->isRunning || (mainState->sessionState == XR_SESSION_STATE_STOPPING)) {
-                return OptionalSessionStateChange { true, sessionState = XR_SESSION_STATE_VISIBLE };
-            } else if((mainState->sessionState == XR_SESSION_STATE_VISIBLE) || (mainState->sessionState == XR_SESSION_STATE_SYNCHRONIZED)) {
-                return OptionalSessionStateChange { true, sessionState = XR_SESSION_STATE_VISIBLE };
-            }
-            break;
+D3D11OverlaySwapchainImages::~D3D11OverlaySwapchainImages()
+{
+    // CreateTexture makes single-sampled textures.  Formats we can't size
+    // aren't pooled, so they can't push the pool past its capacity.
+    uint64_t bytes = (uint64_t(width) * height * GetDXGIFormatBitsPerPixel(format) + 7) / 8;
+    auto texturePool = (bytes > 0) ? pool.lock() : nullptr;
+
+    for(size_t i = 0; i < textures.size(); i++) {
+        SharedTexturePool::Texture texture { textures[i], localHandles[i] };
+        if(texturePool && texture.texture && texture.localHandle && ResetForPool((uint32_t)i)) {
+            texturePool->Give(poolKey, texture, bytes);
+        } else {
+            texture.Free();
+        }
+    }
+    for(auto fence: fences) {
+        if(fence) {
+            fence->Release();
+        }
+    }
+    if(d3d11Context4) {
+        d3d11Context4->Release();
+    }
+}
 
-        case XR_SESSION_STATE_STOPPING:
-            if(!isRunning) {
-                return OptionalSessionStateChange { true, sessionState = XR_SESSION_STATE_IDLE };
-            }
-            break;
+bool D3D11OverlaySwapchainImages::GetImages(XrInstance instance, uint32_t count, XrSwapchainImageBaseHeader* images)
+{
+    if(images[0].type != XR_TYPE_SWAPCHAIN_IMAGE_D3D11_KHR) {
+        LogWrongSwapchainImageType(instance, images[0].type, "XR_TYPE_SWAPCHAIN_IMAGE_D3D11_KHR");
+        return false;
+    }
 
-        default:
-            // No other combination of states requires an Overlay SessionStateChange
-            break;
+    // Give back the "local" swapchainimages (rendertarget) for rendering
+    auto sci = reinterpret_cast<XrSwapchainImageD3D11KHR*>(images);
+    for(uint32_t i = 0; i < count; i++) {
+        sci[i].texture = textures[i];
     }
+    return true;
+}
 
-    return OptionalSessionStateChange { false, XR_SESSION_STATE_UNKNOWN };
+SwapchainImageHandoff D3D11OverlaySwapchainImages::Acquire(uint32_t index, SwapchainImageOwner owner, DWORD timeoutMs)
+{
+    // The app's rendering after this waits on its GPU for Main to give the image back
+    if(releaseCounts[index] > 0) {
+        HRESULT hresult = d3d11Context4->Wait(fences[index], 2 * releaseCounts[index]);
+        if(hresult != S_OK) {
+            LogWindowsError(hresult, "xrWaitSwapchainImage", "Wait", __FILE__, __LINE__);
+            return SWAPCHAIN_IMAGE_HANDOFF_FAILED;
+        }
+    }
+    overlayHolds[index] = true;
+    return SWAPCHAIN_IMAGE_HANDOFF_DONE;
 }
 
+bool D3D11OverlaySwapchainImages::Release(uint32_t index, SwapchainImageOwner owner)
+{
+    HRESULT hresult = d3d11Context4->Signal(fences[index], 2 * releaseCounts[index] + 1);
+    if(hresult != S_OK) {
+        LogWindowsError(hresult, "xrReleaseSwapchainImage", "Signal", __FILE__, __LINE__);
+        return false;
+    }
+    // Main's GPU waits for this signal, so it mustn't sit in the app's unsubmitted commands
+    d3d11Context4->Flush();
+    releaseCounts[index]++;
+    overlayHolds[index] = false;
+    return true;
+}
 
-SwapchainCachedData::~SwapchainCachedData()
+bool ExportedOverlaySwapchainImages::Create(XrInstance instance, uint32_t count, HANDLE mainProcessHandle)
 {
-    for(HANDLE acquired : remoteImagesAcquired) {
-        IDXGIKeyedMutex* keyedMutex;
-        ID3D11Texture2D *sharedTexture;
-        auto it = handleTextureMap.find(acquired);
-        if(it != handleTextureMap.end()) {
-            sharedTexture = it->second;
-            HRESULT result = sharedTexture->QueryInterface( __uuidof(IDXGIKeyedMutex), (LPVOID*)&keyedMutex);
-            if(result == S_OK) {
-                keyedMutex->ReleaseSync(KEYED_MUTEX_OVERLAY);
-                keyedMutex->Release();
-            }
+    ID3D11Device1 *device1;
+    HRESULT result = d3d11->QueryInterface(__uuidof (ID3D11Device1), (void **)&device1);
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "QueryInterface", __FILE__, __LINE__);
+        return false;
+    }
+
+    textures.resize(handles.size(), nullptr);
+    for(size_t i = 0; i < handles.size(); i++) {
+        result = device1->OpenSharedResource1(handles[i], __uuidof(ID3D11Texture2D), (LPVOID*) &textures[i]);
+        if(result != S_OK) {
+            LogWindowsError(result, "xrCreateSwapchain", "OpenSharedResource1", __FILE__, __LINE__);
+            device1->Release();
+            return false;
         }
     }
-    remoteImagesAcquired.clear();
-    for(auto shared : handleTextureMap) {
-        shared.second->Release();
-        CloseHandle(shared.first);
+    device1->Release();
+
+    ID3D11DeviceContext* d3d11Context;
+    d3d11->GetImmediateContext(&d3d11Context);
+    result = d3d11Context->QueryInterface(__uuidof(ID3D11DeviceContext4), (void **)&d3d11Context4);
+    d3d11Context->Release();
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "QueryInterface", __FILE__, __LINE__);
+        d3d11Context4 = nullptr;
+        return false;
     }
-    for(auto texture : swapchainImages) {
-        texture->Release();
+
+    // One fence for the swapchain, since Main waits for releases in order
+    ID3D11Device5 *device5;
+    result = d3d11->QueryInterface(__uuidof(ID3D11Device5), (void **)&device5);
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "QueryInterface", __FILE__, __LINE__);
+        return false;
+    }
+    result = device5->CreateFence(0, D3D11_FENCE_FLAG_SHARED, __uuidof(ID3D11Fence), (void **)&renderingFence);
+    device5->Release();
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "CreateFence", __FILE__, __LINE__);
+        renderingFence = nullptr;
+        return false;
+    }
+
+    HANDLE localHandle = NULL;
+    result = renderingFence->CreateSharedHandle(NULL, GENERIC_ALL, NULL, &localHandle);
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "CreateSharedHandle", __FILE__, __LINE__);
+        return false;
+    }
+    bool duplicated = DuplicateHandleIntoMain(localHandle, mainProcessHandle, &syncHandle);
+    CloseHandle(localHandle);
+    return duplicated;
+}
+
+ExportedOverlaySwapchainImages::~ExportedOverlaySwapchainImages()
+{
+    if(renderingFence) {
+        renderingFence->Release();
+    }
+    if(d3d11Context4) {
+        d3d11Context4->Release();
+    }
+    for(auto texture: textures) {
+        if(texture) {
+            texture->Release();
+        }
+    }
+    for(auto handle: handles) {
+        CloseHandle(handle);
+    }
+}
+
+bool ExportedOverlaySwapchainImages::GetImages(XrInstance instance, uint32_t count, XrSwapchainImageBaseHeader* images)
+{
+    if(images[0].type != XR_TYPE_SWAPCHAIN_IMAGE_D3D11_KHR) {
+        LogWrongSwapchainImageType(instance, images[0].type, "XR_TYPE_SWAPCHAIN_IMAGE_D3D11_KHR");
+        return false;
+    }
+
+    auto sci = reinterpret_cast<XrSwapchainImageD3D11KHR*>(images);
+    for(uint32_t i = 0; i < count; i++) {
+        sci[i].texture = textures[i];
+    }
+    return true;
+}
+
+bool ExportedOverlaySwapchainImages::Release(uint32_t index, SwapchainImageOwner owner)
+{
+    // Main's GPU waits for this before the runtime's xrReleaseSwapchainImage,
+    // so the app's render thread doesn't wait for its GPU here
+    HRESULT result = d3d11Context4->Signal(renderingFence, renderingFenceValue + 1);
+    if(result != S_OK) {
+        LogWindowsError(result, "xrReleaseSwapchainImage", "Signal", __FILE__, __LINE__);
+        return false;
+    }
+    d3d11Context4->Flush();
+    renderingFenceValue++;
+    return true;
+}
+
+ExportedMainSwapchainImages::ExportedMainSwapchainImages(ID3D11Device* d3d11Device, uint32_t imageCount) :
+    waitValues(imageCount, 0)
+{
+    HRESULT result = d3d11Device->QueryInterface(__uuidof (ID3D11Device5), (void **)&d3d11Device5);
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "QueryInterface", __FILE__, __LINE__);
+        d3d11Device5 = nullptr;
+    }
+    ID3D11DeviceContext* immediateContext;
+    d3d11Device->GetImmediateContext(&immediateContext);
+    result = immediateContext->QueryInterface(__uuidof(ID3D11DeviceContext4), (void **)&immediateContext4);
+    immediateContext->Release();
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "QueryInterface", __FILE__, __LINE__);
+        immediateContext4 = nullptr;
+    }
+}
+
+ExportedMainSwapchainImages::~ExportedMainSwapchainImages()
+{
+    if(fence) {
+        fence->Release();
+    }
+    if(syncHandle) {
+        CloseHandle(syncHandle);
+    }
+    if(immediateContext4) {
+        immediateContext4->Release();
+    }
+    if(d3d11Device5) {
+        d3d11Device5->Release();
+    }
+}
+
+bool ExportedMainSwapchainImages::OpenSourceImage(uint32_t index, HANDLE sourceImage, HANDLE sourceSync)
+{
+    // Every image comes with the swapchain's one fence
+    if(fence && (syncHandle == sourceSync)) {
+        return true;
+    }
+    if(fence || !d3d11Device5 || !immediateContext4) {
+        return false;
+    }
+    HRESULT result = d3d11Device5->OpenSharedFence(sourceSync, __uuidof(ID3D11Fence), (void **)&fence);
+    if(result != S_OK) {
+        LogWindowsError(result, nullptr, "OpenSharedFence", __FILE__, __LINE__);
+        fence = nullptr;
+        return false;
+    }
+    syncHandle = sourceSync;
+    return true;
+}
+
+SwapchainImageHandoff ExportedMainSwapchainImages::Acquire(uint32_t index, SwapchainImageOwner owner, DWORD timeoutMs)
+{
+    if(!fence) {
+        return SWAPCHAIN_IMAGE_HANDOFF_FAILED;
     }
-    handleTextureMap.clear();
+    // The overlay signals the next value on each release
+    waitValues[index] = ++releaseCount;
+    return SWAPCHAIN_IMAGE_HANDOFF_DONE;
+}
+
+bool ExportedMainSwapchainImages::WaitForOverlayRendering(uint32_t index)
+{
+    HRESULT result = immediateContext4->Wait(fence, waitValues[index]);
+    if(result != S_OK) {
+        LogWindowsError(result, "xrReleaseSwapchainImage", "Wait", __FILE__, __LINE__);
+        return false;
+    }
+    return true;
+}
+
+uint32_t GetCpuImageBytesPerPixel(DXGI_FORMAT format)
+{
+    switch(format) {
+        case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+        case DXGI_FORMAT_R8G8B8A8_UNORM:
+        case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+        case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+        case DXGI_FORMAT_B8G8R8A8_UNORM:
+        case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+        case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+        case DXGI_FORMAT_B8G8R8X8_UNORM:
+        case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+        case DXGI_FORMAT_R10G10B10A2_UNORM:
+        case DXGI_FORMAT_R11G11B10_FLOAT:
+            return 4;
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+        case DXGI_FORMAT_R16G16B16A16_UNORM:
+            return 8;
+        case DXGI_FORMAT_R32G32B32A32_FLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+uint32_t GetDXGIFormatBitsPerPixel(DXGI_FORMAT format)
+{
+    switch(format) {
+        case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+        case DXGI_FORMAT_R32G32B32A32_FLOAT:
+        case DXGI_FORMAT_R32G32B32A32_UINT:
+        case DXGI_FORMAT_R32G32B32A32_SINT:
+            return 128;
+        case DXGI_FORMAT_R32G32B32_TYPELESS:
+        case DXGI_FORMAT_R32G32B32_FLOAT:
+        case DXGI_FORMAT_R32G32B32_UINT:
+        case DXGI_FORMAT_R32G32B32_SINT:
+            return 96;
+        case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+        case DXGI_FORMAT_R16G16B16A16_UNORM:
+        case DXGI_FORMAT_R16G16B16A16_UINT:
+        case DXGI_FORMAT_R16G16B16A16_SNORM:
+        case DXGI_FORMAT_R16G16B16A16_SINT:
+        case DXGI_FORMAT_R32G32_TYPELESS:
+        case DXGI_FORMAT_R32G32_FLOAT:
+        case DXGI_FORMAT_R32G32_UINT:
+        case DXGI_FORMAT_R32G32_SINT:
+        case DXGI_FORMAT_R32G8X24_TYPELESS:
+        case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+        case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+        case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+            return 64;
+        case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+        case DXGI_FORMAT_R10G10B10A2_UNORM:
+        case DXGI_FORMAT_R10G10B10A2_UINT:
+        case DXGI_FORMAT_R11G11B10_FLOAT:
+        case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+        case DXGI_FORMAT_R8G8B8A8_UNORM:
+        case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+        case DXGI_FORMAT_R8G8B8A8_UINT:
+        case DXGI_FORMAT_R8G8B8A8_SNORM:
+        case DXGI_FORMAT_R8G8B8A8_SINT:
+        case DXGI_FORMAT_R16G16_TYPELESS:
+        case DXGI_FORMAT_R16G16_FLOAT:
+        case DXGI_FORMAT_R16G16_UNORM:
+        case DXGI_FORMAT_R16G16_UINT:
+        case DXGI_FORMAT_R16G16_SNORM:
+        case DXGI_FORMAT_R16G16_SINT:
+        case DXGI_FORMAT_R32_TYPELESS:
+        case DXGI_FORMAT_D32_FLOAT:
+        case DXGI_FORMAT_R32_FLOAT:
+        case DXGI_FORMAT_R32_UINT:
+        case DXGI_FORMAT_R32_SINT:
+        case DXGI_FORMAT_R24G8_TYPELESS:
+        case DXGI_FORMAT_D24_UNORM_S8_UINT:
+        case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+        case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+        case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
+        case DXGI_FORMAT_R8G8_B8G8_UNORM:
+        case DXGI_FORMAT_G8R8_G8B8_UNORM:
+        case DXGI_FORMAT_B8G8R8A8_UNORM:
+        case DXGI_FORMAT_B8G8R8X8_UNORM:
+        case DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM:
+        case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+        case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+        case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+        case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+            return 32;
+        case DXGI_FORMAT_R8G8_TYPELESS:
+        case DXGI_FORMAT_R8G8_UNORM:
+        case DXGI_FORMAT_R8G8_UINT:
+        case DXGI_FORMAT_R8G8_SNORM:
+        case DXGI_FORMAT_R8G8_SINT:
+        case DXGI_FORMAT_R16_TYPELESS:
+        case DXGI_FORMAT_R16_FLOAT:
+        case DXGI_FORMAT_D16_UNORM:
+        case DXGI_FORMAT_R16_UNORM:
+        case DXGI_FORMAT_R16_UINT:
+        case DXGI_FORMAT_R16_SNORM:
+        case DXGI_FORMAT_R16_SINT:
+        case DXGI_FORMAT_B5G6R5_UNORM:
+        case DXGI_FORMAT_B5G5R5A1_UNORM:
+        case DXGI_FORMAT_B4G4R4A4_UNORM:
+            return 16;
+        case DXGI_FORMAT_R8_TYPELESS:
+        case DXGI_FORMAT_R8_UNORM:
+        case DXGI_FORMAT_R8_UINT:
+        case DXGI_FORMAT_R8_SNORM:
+        case DXGI_FORMAT_R8_SINT:
+        case DXGI_FORMAT_A8_UNORM:
+        case DXGI_FORMAT_BC2_TYPELESS:
+        case DXGI_FORMAT_BC2_UNORM:
+        case DXGI_FORMAT_BC2_UNORM_SRGB:
+        case DXGI_FORMAT_BC3_TYPELESS:
+        case DXGI_FORMAT_BC3_UNORM:
+        case DXGI_FORMAT_BC3_UNORM_SRGB:
+        case DXGI_FORMAT_BC5_TYPELESS:
+        case DXGI_FORMAT_BC5_UNORM:
+        case DXGI_FORMAT_BC5_SNORM:
+        case DXGI_FORMAT_BC6H_TYPELESS:
+        case DXGI_FORMAT_BC6H_UF16:
+        case DXGI_FORMAT_BC6H_SF16:
+        case DXGI_FORMAT_BC7_TYPELESS:
+        case DXGI_FORMAT_BC7_UNORM:
+        case DXGI_FORMAT_BC7_UNORM_SRGB:
+            return 8;
+        case DXGI_FORMAT_BC1_TYPELESS:
+        case DXGI_FORMAT_BC1_UNORM:
+        case DXGI_FORMAT_BC1_UNORM_SRGB:
+        case DXGI_FORMAT_BC4_TYPELESS:
+        case DXGI_FORMAT_BC4_UNORM:
+        case DXGI_FORMAT_BC4_SNORM:
+            return 4;
+        case DXGI_FORMAT_R1_UNORM:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+SwapchainImageHandoff CpuSharedImage::Acquire(SwapchainImageOwner owner, DWORD timeoutMs)
+{
+    // Short waits so a Release whose signal another waiter consumed isn't missed for long
+    constexpr DWORD maxWaitMs = 4;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    uint32_t expected = owner;
+    while(!header->ownership.compare_exchange_strong(expected, owner | CpuSharedImageHeader::HELD_BIT)) {
+        DWORD waitMs = maxWaitMs;
+        if(timeoutMs != INFINITE) {
+            auto now = std::chrono::steady_clock::now();
+            if(now >= deadline) {
+                return SWAPCHAIN_IMAGE_HANDOFF_TIMEOUT;
+            }
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1;
+            waitMs = std::min(maxWaitMs, (DWORD)remaining);
+        }
+        if(changed) {
+            WaitForSingleObject(changed, waitMs);
+        } else {
+            Sleep(1);
+        }
+        expected = owner;
+    }
+    return SWAPCHAIN_IMAGE_HANDOFF_DONE;
+}
+
+void CpuSharedImage::Release(SwapchainImageOwner owner)
+{
+    header->ownership.store(owner);
+    if(changed) {
+        SetEvent(changed);
+    }
+}
+
+bool CpuOverlaySwapchainImages::Create(XrInstance instance, uint32_t count, HANDLE mainProcessHandle)
+{
+    images.resize(count);
+    handles.resize(count, NULL);
+    syncHandles.resize(count, NULL);
+
+    uint32_t rowPitch = width * bytesPerPixel;
+    uint64_t size = sizeof(CpuSharedImageHeader) + uint64_t(rowPitch) * height;
+
+    for(uint32_t i = 0; i < count; i++) {
+        auto& image = images[i];
+
+        image.mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, NULL);
+        if(image.mapping == NULL) {
+            LogWindowsLastError("xrCreateSwapchain", "CreateFileMappingA", __FILE__, __LINE__);
+            return false;
+        }
+        void* view = MapViewOfFile(image.mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+        if(view == NULL) {
+            LogWindowsLastError("xrCreateSwapchain", "MapViewOfFile", __FILE__, __LINE__);
+            return false;
+        }
+
+        // Starts out acquirable by the overlay, like a new keyed mutex
+        image.header = new(view) CpuSharedImageHeader;
+        image.header->ownership = SWAPCHAIN_IMAGE_OWNER_OVERLAY;
+        image.header->width = width;
+        image.header->height = height;
+        image.header->rowPitch = rowPitch;
+
+        if(!DuplicateHandleIntoMain(image.mapping, mainProcessHandle, &handles[i])) {
+            return false;
+        }
+
+        // Unnamed, so only the two processes holding handles can signal it
+        image.changed = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+        if(image.changed == NULL) {
+            LogWindowsLastError("xrCreateSwapchain", "CreateEventA", __FILE__, __LINE__);
+            return false;
+        }
+        if(!DuplicateHandleIntoMain(image.changed, mainProcessHandle, &syncHandles[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+CpuOverlaySwapchainImages::~CpuOverlaySwapchainImages()
+{
+    for(auto& image: images) {
+        if(image.header) {
+            UnmapViewOfFile(image.header);
+        }
+        if(image.mapping) {
+            CloseHandle(image.mapping);
+        }
+        if(image.changed) {
+            CloseHandle(image.changed);
+        }
+    }
+}
+
+bool CpuOverlaySwapchainImages::GetImages(XrInstance instance, uint32_t count, XrSwapchainImageBaseHeader* swapchainImages)
+{
+    if(swapchainImages[0].type != XR_TYPE_SWAPCHAIN_IMAGE_CPU_EXTX) {
+        LogWrongSwapchainImageType(instance, swapchainImages[0].type, "XR_TYPE_SWAPCHAIN_IMAGE_CPU_EXTX");
+        return false;
+    }
+
+    auto sci = reinterpret_cast<XrSwapchainImageCpuEXTX*>(swapchainImages);
+    for(uint32_t i = 0; i < count; i++) {
+        sci[i].pixels = images[i].GetPixels();
+        sci[i].rowPitch = images[i].header->rowPitch;
+    }
+    return true;
+}
+
+SwapchainImageHandoff CpuOverlaySwapchainImages::Acquire(uint32_t index, SwapchainImageOwner owner, DWORD timeoutMs)
+{
+    return images[index].Acquire(owner, timeoutMs);
+}
+
+bool CpuOverlaySwapchainImages::Release(uint32_t index, SwapchainImageOwner owner)
+{
+    images[index].Release(owner);
+    return true;
+}
+
+SwapchainCachedData::~SwapchainCachedData()
+{
+    // Let the overlay have back any images Main still holds
+    for(uint32_t index = 0; index < imageState.size(); index++) {
+        if(imageState[index] & SWAPCHAIN_IMAGE_STATE_HELD_BIT) {
+            images->Release(index, SWAPCHAIN_IMAGE_OWNER_OVERLAY);
+            imageState[index] &= ~SWAPCHAIN_IMAGE_STATE_HELD_BIT;
+        }
+    }
+}
+
+D3D11MainSwapchainImages::D3D11MainSwapchainImages(ID3D11Device* d3d11Device_, const std::vector<ID3D11Texture2D*>& runtimeImages_) :
+    d3d11Device(nullptr),
+    runtimeImages(runtimeImages_),
+    sourceImages(runtimeImages_.size())
+{
+    for(auto texture : runtimeImages) {
+        texture->AddRef();
+    }
+    HRESULT result = d3d11Device_->QueryInterface(__uuidof (ID3D11Device1), (void **)&d3d11Device);
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "QueryInterface", __FILE__, __LINE__);
+        d3d11Device = nullptr;
+    }
+
+    // Without these the overlay's fences can't be opened, and OpenSourceImage fails
+    result = d3d11Device_->QueryInterface(__uuidof (ID3D11Device5), (void **)&d3d11Device5);
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "QueryInterface", __FILE__, __LINE__);
+        d3d11Device5 = nullptr;
+    }
+    ID3D11DeviceContext* immediateContext;
+    d3d11Device_->GetImmediateContext(&immediateContext);
+    result = immediateContext->QueryInterface(__uuidof(ID3D11DeviceContext4), (void **)&immediateContext4);
+    immediateContext->Release();
+    if(result != S_OK) {
+        LogWindowsError(result, "xrCreateSwapchain", "QueryInterface", __FILE__, __LINE__);
+        immediateContext4 = nullptr;
+    }
+}
+
+D3D11MainSwapchainImages::~D3D11MainSwapchainImages()
+{
+    for(auto& image : sourceImages) {
+        CloseSourceImage(image);
+    }
+    for(auto texture : runtimeImages) {
+        texture->Release();
+    }
+    if(immediateContext4) {
+        immediateContext4->Release();
+    }
+    if(d3d11Device5) {
+        d3d11Device5->Release();
+    }
+    if(d3d11Device) {
+        d3d11Device->Release();
+    }
+}
+
+void D3D11MainSwapchainImages::CloseSourceImage(SourceImage& image)
+{
+    if(image.fence) {
+        image.fence->Release();
+    }
+    if(image.syncHandle) {
+        CloseHandle(image.syncHandle);
+    }
+    if(image.texture) {
+        image.texture->Release();
+    }
+    if(image.handle) {
+        CloseHandle(image.handle);
+    }
+    image = SourceImage();
+}
+
+bool D3D11MainSwapchainImages::OpenSourceImage(uint32_t index, HANDLE sourceImage, HANDLE sourceSync)
+{
+    if(index >= sourceImages.size()) {
+        return false;
+    }
+    SourceImage& image = sourceImages[index];
+    if(image.handle == sourceImage) {
+        return true;
+    }
+    if(!d3d11Device || !d3d11Device5 || !immediateContext4) {
+        return false;
+    }
+
+    // The overlay sends the same handles for an image every time, so this is once per image
+    CloseSourceImage(image);
+
+    HRESULT result = d3d11Device->OpenSharedResource1(sourceImage, __uuidof(ID3D11Texture2D), (LPVOID*) &image.texture);
+    if(result != S_OK) {
+        LogWindowsError(result, nullptr, "OpenSharedResource1", __FILE__, __LINE__);
+        image.texture = nullptr;
+        return false;
+    }
+    result = d3d11Device5->OpenSharedFence(sourceSync, __uuidof(ID3D11Fence), (void **)&image.fence);
+    if(result != S_OK) {
+        LogWindowsError(result, nullptr, "OpenSharedFence", __FILE__, __LINE__);
+        image.fence = nullptr;
+        CloseSourceImage(image);
+        return false;
+    }
+    image.handle = sourceImage;
+    image.syncHandle = sourceSync;
+
+    return true;
+}
+
+SwapchainImageHandoff D3D11MainSwapchainImages::Acquire(uint32_t index, SwapchainImageOwner owner, DWORD timeoutMs)
+{
+    // Never waits; WaitForOverlayRendering makes the GPU wait instead
+    SourceImage& image = sourceImages[index];
+    if(!image.fence) {
+        return SWAPCHAIN_IMAGE_HANDOFF_FAILED;
+    }
+    image.releaseCount++;
+    return SWAPCHAIN_IMAGE_HANDOFF_DONE;
+}
+
+bool D3D11MainSwapchainImages::Release(uint32_t index, SwapchainImageOwner owner)
+{
+    SourceImage& image = sourceImages[index];
+    if(!image.fence) {
+        return false;
+    }
+    if(image.releaseCount == 0) {
+        return true;
+    }
+
+    // Also waits, in case the copy queue never did; the overlay's signal must
+    // land first, or it would take the fence back below this one
+    HRESULT result = immediateContext4->Wait(image.fence, 2 * image.releaseCount - 1);
+    if(result == S_OK) {
+        result = immediateContext4->Signal(image.fence, 2 * image.releaseCount);
+    }
+    if(result != S_OK) {
+        LogWindowsError(result, "xrWaitSwapchainImage", "Signal", __FILE__, __LINE__);
+        return false;
+    }
+    // The overlay's GPU waits for this signal
+    immediateContext4->Flush();
+    return true;
+}
+
+bool D3D11MainSwapchainImages::WaitForOverlayRendering(uint32_t index)
+{
+    SourceImage& image = sourceImages[index];
+    if(!image.fence) {
+        return false;
+    }
+    HRESULT result = immediateContext4->Wait(image.fence, 2 * image.releaseCount - 1);
+    if(result != S_OK) {
+        LogWindowsError(result, "xrReleaseSwapchainImage", "Wait", __FILE__, __LINE__);
+        return false;
+    }
+    return true;
+}
+
+bool D3D11MainSwapchainImages::CopyToRuntimeImage(uint32_t index, const SwapchainImageDirtyRegion& region, ID3D11DeviceContext* context)
+{
+    ID3D11Texture2D *sharedTexture = sourceImages[index].texture;
+    if(!sharedTexture) {
+        return false;
+    }
+
+    ID3D11Texture2D* runtimeImage = runtimeImages[index];
+    D3D11_TEXTURE2D_DESC desc;
+    runtimeImage->GetDesc(&desc);
+
+    // CopySubresourceRegion can't take part of a multisampled or depth image
+    bool partial = !region.whole && (desc.SampleDesc.Count == 1) && (desc.MipLevels == 1) && !(desc.BindFlags & D3D11_BIND_DEPTH_STENCIL);
+    if(!partial) {
+        context->CopyResource(runtimeImage, sharedTexture);
+        return true;
+    }
+
+    for(UINT slice = 0; slice < desc.ArraySize; slice++) {
+        UINT subresource = D3D11CalcSubresource(0, slice, 1);
+        for(const auto& rect: region.rects) {
+            D3D11_BOX box { (UINT)rect.offset.x, (UINT)rect.offset.y, 0, (UINT)(rect.offset.x + rect.extent.width), (UINT)(rect.offset.y + rect.extent.height), 1 };
+            context->CopySubresourceRegion(runtimeImage, subresource, box.left, box.top, 0, sharedTexture, subresource, &box);
+        }
+    }
+    return true;
+}
+
+bool D3D11MainSwapchainImages::ExportRuntimeImages(HANDLE processHandle, std::vector<HANDLE>& exported)
+{
+    // Runtimes aren't required to make their images shareable, so check all before exporting any.
+    // A keyed mutex would have to be acquired around the overlay's rendering, which zero copy doesn't do
+    for(auto texture : runtimeImages) {
+        D3D11_TEXTURE2D_DESC desc;
+        texture->GetDesc(&desc);
+        if(!(desc.MiscFlags & D3D11_RESOURCE_MISC_SHARED_NTHANDLE) || (desc.MiscFlags & D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX)) {
+            return false;
+        }
+    }
+
+    for(auto texture : runtimeImages) {
+        HANDLE handle = NULL;
+        IDXGIResource1* sharedResource = NULL;
+        HRESULT result = texture->QueryInterface(__uuidof(IDXGIResource1), (LPVOID*) &sharedResource);
+        if(result == S_OK) {
+            result = sharedResource->CreateSharedHandle(NULL, DXGI_SHARED_RESOURCE_READ | DXGI_SHARED_RESOURCE_WRITE, NULL, &handle);
+            sharedResource->Release();
+        }
+
+        HANDLE remoteHandle = NULL;
+        bool duplicated = (result == S_OK) && DuplicateHandle(GetCurrentProcess(), handle, processHandle, &remoteHandle, 0, FALSE, DUPLICATE_SAME_ACCESS);
+        if(handle) {
+            CloseHandle(handle);
+        }
+        if(!duplicated) {
+            if(result != S_OK) {
+                LogWindowsError(result, "xrCreateSwapchain", "CreateSharedHandle", __FILE__, __LINE__);
+            } else {
+                LogWindowsLastError("xrCreateSwapchain", "DuplicateHandle", __FILE__, __LINE__);
+            }
+            // Close what we already put in the other process
+            for(HANDLE h : exported) {
+                DuplicateHandle(processHandle, h, NULL, NULL, 0, FALSE, DUPLICATE_CLOSE_SOURCE);
+            }
+            exported.clear();
+            return false;
+        }
+        exported.push_back(remoteHandle);
+    }
+    return true;
+}
+
+CpuMainSwapchainImages::CpuMainSwapchainImages(ID3D11Device* d3d11Device_, const std::vector<ID3D11Texture2D*>& runtimeImages_) :
+    d3d11Device(d3d11Device_),
+    runtimeImages(runtimeImages_),
+    sourceImages(runtimeImages_.size())
+{
+    for(auto texture : runtimeImages) {
+        texture->AddRef();
+    }
+
+    D3D11_TEXTURE2D_DESC desc;
+    runtimeImages[0]->GetDesc(&desc);
+    bytesPerPixel = GetCpuImageBytesPerPixel(desc.Format);
+    height = desc.Height;
+    rowPitch = desc.Width * bytesPerPixel;
+
+    // Without driver command lists, the runtime offsets a deferred
+    // UpdateSubresource's source by the box origin a second time
+    D3D11_FEATURE_DATA_THREADING threading {};
+    if(d3d11Device->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading)) == S_OK) {
+        deferredOffsetQuirk = !threading.DriverCommandLists;
+    }
+}
+
+CpuMainSwapchainImages::~CpuMainSwapchainImages()
+{
+    for(auto& image : sourceImages) {
+        CloseSourceImage(image);
+    }
+    for(auto texture : runtimeImages) {
+        texture->Release();
+    }
+}
+
+void CpuMainSwapchainImages::CloseSourceImage(CpuSharedImage& image)
+{
+    if(image.header) {
+        UnmapViewOfFile(image.header);
+    }
+    if(image.mapping) {
+        CloseHandle(image.mapping);
+    }
+    if(image.changed) {
+        CloseHandle(image.changed);
+    }
+    image = CpuSharedImage();
+}
+
+bool CpuMainSwapchainImages::OpenSourceImage(uint32_t index, HANDLE sourceImage, HANDLE sourceSync)
+{
+    if(index >= sourceImages.size()) {
+        return false;
+    }
+    CpuSharedImage& image = sourceImages[index];
+    if(image.mapping == sourceImage) {
+        return true;
+    }
+
+    CloseSourceImage(image);
+
+    void* view = MapViewOfFile(sourceImage, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if(view == NULL) {
+        LogWindowsLastError(nullptr, "MapViewOfFile", __FILE__, __LINE__);
+        return false;
+    }
+
+    // The overlay sized the section; don't trust it to hold the whole swapchain image
+    MEMORY_BASIC_INFORMATION memoryInfo;
+    uint64_t needed = sizeof(CpuSharedImageHeader) + uint64_t(rowPitch) * height;
+    if((bytesPerPixel == 0) || (VirtualQuery(view, &memoryInfo, sizeof(memoryInfo)) == 0) || (memoryInfo.RegionSize < needed)) {
+        OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrReleaseSwapchainImage",
+            OverlaysLayerNoObjectInfo, fmt("overlay's CPU image is smaller than the %llu bytes its swapchain needs", needed).c_str());
+        UnmapViewOfFile(view);
+        return false;
+    }
+
+    image.mapping = sourceImage;
+    image.header = reinterpret_cast<CpuSharedImageHeader*>(view);
+    // Without the event, Acquire still works but polls with Sleep
+    image.changed = sourceSync;
+    return true;
+}
+
+SwapchainImageHandoff CpuMainSwapchainImages::Acquire(uint32_t index, SwapchainImageOwner owner, DWORD timeoutMs)
+{
+    if(!sourceImages[index].header) {
+        return SWAPCHAIN_IMAGE_HANDOFF_FAILED;
+    }
+    return sourceImages[index].Acquire(owner, timeoutMs);
+}
+
+bool CpuMainSwapchainImages::Release(uint32_t index, SwapchainImageOwner owner)
+{
+    if(!sourceImages[index].header) {
+        return false;
+    }
+    sourceImages[index].Release(owner);
+    return true;
+}
+
+bool CpuMainSwapchainImages::CopyToRuntimeImage(uint32_t index, const SwapchainImageDirtyRegion& region, ID3D11DeviceContext* context)
+{
+    CpuSharedImage& image = sourceImages[index];
+    if(!image.header) {
+        return false;
+    }
+
+    // A deferred context takes its own copy of the pixels here
+    if(region.whole) {
+        context->UpdateSubresource(runtimeImages[index], 0, nullptr, image.GetPixels(), rowPitch, 0);
+        return true;
+    }
+
+    bool offsetTwice = deferredOffsetQuirk && (context->GetType() == D3D11_DEVICE_CONTEXT_DEFERRED);
+    for(const auto& rect: region.rects) {
+        D3D11_BOX box { (UINT)rect.offset.x, (UINT)rect.offset.y, 0, (UINT)(rect.offset.x + rect.extent.width), (UINT)(rect.offset.y + rect.extent.height), 1 };
+        const unsigned char* source = image.GetPixels();
+        if(!offsetTwice) {
+            source += box.top * rowPitch + box.left * bytesPerPixel;
+        }
+        context->UpdateSubresource(runtimeImages[index], 0, &box, source, rowPitch, 0);
+    }
+    return true;
+}
+
+void SwapchainCachedData::AddDirtyRects(const XrSwapchainImageDirtyRectsEXTX* dirty)
+{
+    std::vector<XrRect2Di> clipped;
+    if(dirty) {
+        for(uint32_t i = 0; i < dirty->rectCount; i++) {
+            const XrRect2Di& r = dirty->rects[i];
+            int32_t x0 = std::clamp(r.offset.x, 0, width);
+            int32_t y0 = std::clamp(r.offset.y, 0, height);
+            int32_t x1 = std::clamp(r.offset.x + r.extent.width, 0, width);
+            int32_t y1 = std::clamp(r.offset.y + r.extent.height, 0, height);
+            if((x1 > x0) && (y1 > y0)) {
+                clipped.push_back({{x0, y0}, {x1 - x0, y1 - y0}});
+            }
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(dirtyMutex);
+    for(auto& region: runtimeImageDirty) {
+        if(region.whole) {
+            continue;
+        }
+        if(!dirty || (region.rects.size() + clipped.size() > SwapchainImageDirtyRegion::maxRects)) {
+            region.whole = true;
+            region.rects.clear();
+        } else {
+            region.rects.insert(region.rects.end(), clipped.begin(), clipped.end());
+        }
+    }
+}
+
+SwapchainImageDirtyRegion SwapchainCachedData::TakeDirtyRegion(uint32_t runtimeIndex)
+{
+    std::unique_lock<std::mutex> lock(dirtyMutex);
+    SwapchainImageDirtyRegion region;
+    std::swap(region, runtimeImageDirty[runtimeIndex]);
+    runtimeImageDirty[runtimeIndex].whole = false;
+    return region;
+}
+
+void SwapchainCachedData::MarkWholeDirty(uint32_t runtimeIndex)
+{
+    std::unique_lock<std::mutex> lock(dirtyMutex);
+    runtimeImageDirty[runtimeIndex].whole = true;
+    runtimeImageDirty[runtimeIndex].rects.clear();
+}
+
+MainImageCopyQueue::MainImageCopyQueue(ID3D11Device* d3d11Device_) :
+    d3d11Device(d3d11Device_)
+{
+    d3d11Device->AddRef();
+
+    // The app renders on the immediate context from its own threads while
+    // the copy thread executes on it; have D3D11 serialize the two
+    ID3D11Multithread* d3dMultithread;
+    HRESULT result = d3d11Device->QueryInterface(__uuidof(ID3D11Multithread), reinterpret_cast<void**>(&d3dMultithread));
+    if(result == S_OK) {
+        d3dMultithread->SetMultithreadProtected(TRUE);
+        d3dMultithread->Release();
+    } else {
+        LogWindowsError(result, "xrCreateSession", "QueryInterface", __FILE__, __LINE__);
+    }
+
+    result = d3d11Device->CreateDeferredContext(0, &deferredContext);
+    if(result != S_OK) {
+        // e.g. a single-threaded device; copies then go straight to the immediate context
+        LogWindowsError(result, "xrCreateSession", "CreateDeferredContext", __FILE__, __LINE__);
+        deferredContext = nullptr;
+    }
+}
+
+MainImageCopyQueue::~MainImageCopyQueue()
+{
+    Stop();
+}
+
+void MainImageCopyQueue::Start()
+{
+    // Stop() joins before the queue can be destroyed
+    thread = std::thread([this]{ ThreadBody(); });
+}
+
+void MainImageCopyQueue::Stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queued.notify_one();
+    if(thread.joinable()) {
+        thread.join();
+    }
+    if(deferredContext) {
+        deferredContext->Release();
+        deferredContext = nullptr;
+    }
+    if(d3d11Device) {
+        d3d11Device->Release();
+        d3d11Device = nullptr;
+    }
+}
+
+uint64_t MainImageCopyQueue::Enqueue(OverlaysLayerXrSwapchainHandleInfo* swapchainInfo, uint32_t runtimeIndex, bool handedOff, SwapchainImageDirtyRegion&& region, std::shared_ptr<XrSwapchainImageReleaseInfo> releaseInfo)
+{
+    uint64_t sequence;
+    bool dropped;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        sequence = ++lastQueued;
+        // Published before the RPC returns, so a later destroy of the swapchain sees it in flight
+        swapchainInfo->mainAsOverlaySwapchain->lastCopyQueued = sequence;
+        // Main's session is gone, and the runtime image with it
+        dropped = stopping;
+        if(dropped) {
+            lastCompleted = sequence;
+        } else {
+            pending.push_back({swapchainInfo, runtimeIndex, handedOff, std::move(region), std::move(releaseInfo), sequence});
+        }
+    }
+    if(dropped) {
+        completed.notify_all();
+    } else {
+        queued.notify_one();
+    }
+    return sequence;
+}
+
+void MainImageCopyQueue::WaitFor(uint64_t sequence)
+{
+    if(IsDone(sequence)) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    completed.wait(lock, [this, sequence]{ return IsDone(sequence); });
+}
+
+void MainImageCopyQueue::WaitForAll()
+{
+    uint64_t sequence;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        sequence = lastQueued;
+    }
+    WaitFor(sequence);
+}
+
+void MainImageCopyQueue::ThreadBody()
+{
+    ID3D11DeviceContext* immediateContext;
+    d3d11Device->GetImmediateContext(&immediateContext);
+
+    std::vector<MainImageCopy> batch;
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queued.wait(lock, [this]{ return !pending.empty() || stopping; });
+            if(pending.empty()) {
+                break;
+            }
+            batch.swap(pending);
+        }
+
+        ID3D11DeviceContext* context = deferredContext ? deferredContext : immediateContext;
+        for(auto& copy: batch) {
+            auto& mainAsOverlaySwapchain = copy.swapchainInfo->mainAsOverlaySwapchain;
+
+            // One more try without waiting; xrEndFrame may be waiting on this
+            // queue with gSynchronizeEveryProcMutex held, so never wait on an overlay
+            if(!copy.handedOff && (mainAsOverlaySwapchain->images->Acquire(copy.runtimeIndex, SWAPCHAIN_IMAGE_OWNER_MAIN, 0) == SWAPCHAIN_IMAGE_HANDOFF_DONE)) {
+                uint8_t& state = mainAsOverlaySwapchain->imageState[copy.runtimeIndex];
+                state = (state & ~SWAPCHAIN_IMAGE_STATE_STALLED_BIT) | SWAPCHAIN_IMAGE_STATE_HELD_BIT;
+                copy.handedOff = true;
+            }
+
+            bool stalled = !copy.handedOff;
+            if(mainAsOverlaySwapchain->latestReleaseUncopied.exchange(stalled) != stalled) {
+                OverlaysLayerLogMessage(copy.swapchainInfo->parentInstance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT, "xrReleaseSwapchainImage",
+                    OverlaysLayerNoObjectInfo, stalled ? "overlay swapchain stalled: couldn't take a released image, withholding layers showing it" : "overlay swapchain recovered from image handoff stall");
+            }
+
+            if(stalled) {
+                // Released to the runtime uncopied so its rotation continues; it keeps what it lacks until next copied into
+                mainAsOverlaySwapchain->MarkWholeDirty(copy.runtimeIndex);
+            } else if(!mainAsOverlaySwapchain->images->WaitForOverlayRendering(copy.runtimeIndex) ||
+                !mainAsOverlaySwapchain->images->CopyToRuntimeImage(copy.runtimeIndex, copy.region, context)) {
+                OverlaysLayerLogMessage(copy.swapchainInfo->parentInstance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrReleaseSwapchainImage",
+                    OverlaysLayerNoObjectInfo, "couldn't copy an overlay's image into the runtime's image");
+            }
+        }
+
+        if(deferredContext) {
+            ID3D11CommandList* commandList;
+            HRESULT result = deferredContext->FinishCommandList(FALSE, &commandList);
+            if(result == S_OK) {
+                // Leaves the app's state on the immediate context as it was
+                immediateContext->ExecuteCommandList(commandList, TRUE);
+                commandList->Release();
+            } else {
+                LogWindowsError(result, "xrReleaseSwapchainImage", "FinishCommandList", __FILE__, __LINE__);
+            }
+        }
+
+        // The runtime reads its images after commands already submitted on Main's device
+        {
+            std::unique_lock<std::recursive_mutex> HapticQuirkLock(HapticQuirkMutex);
+            for(const auto& copy: batch) {
+                XrResult result = copy.swapchainInfo->downchain->ReleaseSwapchainImage(copy.swapchainInfo->actualHandle, copy.releaseInfo.get());
+                if(!XR_SUCCEEDED(result)) {
+                    OverlaysLayerLogMessage(copy.swapchainInfo->parentInstance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrReleaseSwapchainImage",
+                        OverlaysLayerNoObjectInfo, fmt("runtime's xrReleaseSwapchainImage failed with %d for an overlay's image", result).c_str());
+                    // The overlay's call already returned; its next acquire or wait reports this
+                    XrResult noFailure = XR_SUCCESS;
+                    copy.swapchainInfo->mainAsOverlaySwapchain->releaseFailure.compare_exchange_strong(noFailure, result);
+                }
+            }
+        }
+
+        // Swapchains in this batch may be reclaimed as soon as it's marked done
+        uint64_t done = batch.back().sequence;
+        batch.clear();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            lastCompleted = done;
+        }
+        completed.notify_all();
+    }
+
+    immediateContext->Release();
 }
 
-ID3D11Texture2D* SwapchainCachedData::getSharedTexture(ID3D11Device *d3d11Device, HANDLE sourceHandle)
-{
-    ID3D11Texture2D *sharedTexture;
 
-    ID3D11Device1 *device1;
+// Map removal for each handle type cascades to the handle's children, which
+// are destroyed along with it; only the top-level call unlinks the handle
+// from its parent's child set.
 
-    HRESULT result;
+static void RemoveXrActionSetAndChildrenFromHandleInfoMaps(const OverlaysLayerXrActionSetHandleInfo::Ptr& info)
+{
+    /* remove all XrAction children of this XrActionSet */
+    for(auto action: info->childActions) {
+        OverlaysLayerRemoveXrActionFromHandleInfoMap(action->handle);
+    }
 
-    if((result = d3d11Device->QueryInterface(__uuidof (ID3D11Device1), (void **)&device1)) != S_OK) {
-        LogWindowsError(result, nullptr, "QueryInterface", __FILE__, __LINE__);
-        return nullptr;
+    OverlaysLayerRemoveXrActionSetFromHandleInfoMap(info->handle);
+}
+
+static void RemoveXrSessionAndChildrenFromHandleInfoMaps(const OverlaysLayerXrSessionHandleInfo::Ptr& info)
+{
+    /* remove all XrSwapchain children of this XrSession */
+    for(auto swapchain: info->childSwapchains) {
+        OverlaysLayerRemoveXrSwapchainFromHandleInfoMap(swapchain->localHandle);
     }
 
-    auto it = handleTextureMap.find(sourceHandle);
-    if(it == handleTextureMap.end()) {
-        if((result = device1->OpenSharedResource1(sourceHandle, __uuidof(ID3D11Texture2D), (LPVOID*) &sharedTexture)) != S_OK) {
-            LogWindowsError(result, nullptr, "OpenSharedResource1", __FILE__, __LINE__);
-            return nullptr;
-        }
-        handleTextureMap.insert({sourceHandle, sharedTexture});
-    } else  {
-        sharedTexture = it->second;
+    /* remove all XrSpace children of this XrSession */
+    for(auto space: info->childSpaces) {
+        OverlaysLayerRemoveXrSpaceFromHandleInfoMap(space->localHandle);
     }
-    device1->Release();
 
-    return sharedTexture;
+    OverlaysLayerRemoveXrSessionFromHandleInfoMap(info->localHandle);
 }
 
-
 // LATER could generate
 void OverlaysLayerRemoveXrSpaceHandleInfo(XrSpace localHandle)
 {
@@ -1060,17 +2389,11 @@ void OverlaysLayerRemoveXrActionSetHandleInfo(XrActionSet actionSet)
 {
     OverlaysLayerXrActionSetHandleInfo::Ptr info = OverlaysLayerGetHandleInfoFromXrActionSet(actionSet);
 
-    /* remove all XrAction children of this XrActionSet */
-    for(auto action: info->childActions) {
-        OverlaysLayerRemoveXrActionFromHandleInfoMap(action->handle);
-    }
-
     // remove self from Instance childActionSets
     OverlaysLayerXrInstanceHandleInfo::Ptr instanceInfo = OverlaysLayerGetHandleInfoFromXrInstance(info->parentHandle);
     instanceInfo->childActionSets.erase(info);
 
-
-    OverlaysLayerRemoveXrActionSetFromHandleInfoMap(actionSet);
+    RemoveXrActionSetAndChildrenFromHandleInfoMaps(info);
 }
 
 // LATER could generate
@@ -1078,21 +2401,23 @@ void OverlaysLayerRemoveXrSessionHandleInfo(XrSession session)
 {
     OverlaysLayerXrSessionHandleInfo::Ptr info = OverlaysLayerGetHandleInfoFromXrSession(session);
 
-    /* remove all XrSwapchain children of this XrSession */
-    for(auto swapchain: info->childSwapchains) {
-        OverlaysLayerRemoveXrSwapchainFromHandleInfoMap(swapchain->localHandle);
-    }
-
-    /* remove all XrSpace children of this XrSession */
-    for(auto space: info->childSpaces) {
-        OverlaysLayerRemoveXrSpaceFromHandleInfoMap(space->localHandle);
-    }
-
     // remove self from Instance childSessions
     OverlaysLayerXrInstanceHandleInfo::Ptr instanceInfo = OverlaysLayerGetHandleInfoFromXrInstance(info->parentHandle);
     instanceInfo->childSessions.erase(info);
 
-    OverlaysLayerRemoveXrSessionFromHandleInfoMap(session);
+    RemoveXrSessionAndChildrenFromHandleInfoMaps(info);
+}
+
+// LATER could generate
+void OverlaysLayerRemoveXrDebugUtilsMessengerEXTHandleInfo(XrDebugUtilsMessengerEXT messenger)
+{
+    OverlaysLayerXrDebugUtilsMessengerEXTHandleInfo::Ptr info = OverlaysLayerGetHandleInfoFromXrDebugUtilsMessengerEXT(messenger);
+
+    // remove self from Instance debugUtilsMessengers
+    OverlaysLayerXrInstanceHandleInfo::Ptr instanceInfo = OverlaysLayerGetHandleInfoFromXrInstance(info->parentHandle);
+    instanceInfo->debugUtilsMessengers.erase(messenger);
+
+    OverlaysLayerRemoveXrDebugUtilsMessengerEXTFromHandleInfoMap(messenger);
 }
 
 // LATER could generate
@@ -1100,19 +2425,19 @@ void OverlaysLayerRemoveXrInstanceHandleInfo(XrInstance instance)
 {
     OverlaysLayerXrInstanceHandleInfo::Ptr info = OverlaysLayerGetHandleInfoFromXrInstance(instance);
 
-    /* remove all XrActionSet children of this XrInstance */
+    /* remove all XrActionSet children of this XrInstance and their XrActions */
     for(auto actionSet: info->childActionSets) {
-        OverlaysLayerRemoveXrActionSetFromHandleInfoMap(actionSet->handle);
+        RemoveXrActionSetAndChildrenFromHandleInfoMaps(actionSet);
     }
 
-    /* remove all XrSession children of this XrInstance */
+    /* remove all XrSession children of this XrInstance and their XrSwapchains and XrSpaces */
     for(auto session: info->childSessions) {
-        OverlaysLayerRemoveXrSessionFromHandleInfoMap(session->localHandle);
+        RemoveXrSessionAndChildrenFromHandleInfoMaps(session);
     }
 
-    /* remove all XrSession children of this XrInstance */
-    for(auto messenger: info->childDebugUtilsMessengerEXTs) {
-        OverlaysLayerRemoveXrDebugUtilsMessengerEXTFromHandleInfoMap(messenger->handle);
+    /* remove all XrDebugUtilsMessengerEXT children of this XrInstance */
+    for(auto messenger: info->debugUtilsMessengers) {
+        OverlaysLayerRemoveXrDebugUtilsMessengerEXTFromHandleInfoMap(messenger);
     }
 
     OverlaysLayerRemoveXrInstanceFromHandleInfoMap(instance);
@@ -1234,6 +2559,31 @@ XrResult OverlaysLayerXrCreateApiLayerInstance(const XrInstanceCreateInfo *insta
             OverlaysLayerNoObjectInfo, fmt("gSynchronizeEveryProc set to %s", gSynchronizeEveryProc ? "true" : "false").c_str());
     }
 
+    const char *zero_copy_env = getenv("OVERLAYS_API_LAYER_ZERO_COPY");
+    if(zero_copy_env) {
+        std::string zero_copy = zero_copy_env;
+        std::set<std::string> truths {"true", "TRUE", "True", "1", "yes"};
+        gZeroCopySwapchains = (truths.count(zero_copy) > 0);
+        OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT, "xrCreateInstance", 
+            OverlaysLayerNoObjectInfo, fmt("gZeroCopySwapchains set to %s", gZeroCopySwapchains ? "true" : "false").c_str());
+    }
+
+    const char *texture_pool_env = getenv("OVERLAYS_API_LAYER_TEXTURE_POOL_MB");
+    if(texture_pool_env) {
+        char *end;
+        errno = 0;
+        unsigned long long megabytes = strtoull(texture_pool_env, &end, 10);
+        // strtoull would take leading blanks and a minus sign, and stop at trailing garbage
+        if(!isdigit((unsigned char)texture_pool_env[0]) || (*end != '\0') || (errno == ERANGE)) {
+            OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT, "xrCreateInstance", 
+                OverlaysLayerNoObjectInfo, fmt("OVERLAYS_API_LAYER_TEXTURE_POOL_MB \"%s\" isn't a number of megabytes, keeping %llu bytes", texture_pool_env, gSharedTexturePoolBytes).c_str());
+        } else {
+            gSharedTexturePoolBytes = uint64_t(std::min<unsigned long long>(megabytes, SharedTexturePoolMaxMB)) << 20;
+            OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT, "xrCreateInstance", 
+                OverlaysLayerNoObjectInfo, fmt("gSharedTexturePoolBytes set to %llu", gSharedTexturePoolBytes).c_str());
+        }
+    }
+
     // Validate the API layer info and next API layer info structures before we try to use them
     if (!apiLayerInfo ||
         XR_LOADER_INTERFACE_STRUCT_API_LAYER_CREATE_INFO != apiLayerInfo->structType ||
@@ -1312,6 +2662,7 @@ XrResult OverlaysLayerXrCreateApiLayerInstance(const XrInstanceCreateInfo *insta
     }
 
     OverlaysLayerAddHandleInfoForXrInstance(*instance, instanceInfo);
+    gOverlaysLayerLiveInstanceCount++;
 
     return result;
 }
@@ -1322,6 +2673,12 @@ XrResult OverlaysLayerXrDestroyInstance(XrInstance instance)
     std::shared_ptr<XrGeneratedDispatchTable> next_dispatch = instanceInfo->downchain;
     // instanceInfo->Destroy();
     OverlaysLayerRemoveXrInstanceHandleInfo(instance);
+    instanceInfo.reset();
+
+    // The loader may unload the layer after this; free retired children while the instance is still valid
+    if(--gOverlaysLayerLiveInstanceCount == 0) {
+        OverlaysLayerStopReclaimer();
+    }
 
     next_dispatch->DestroyInstance(instance);
 
@@ -1332,6 +2689,8 @@ NegotiationChannels gNegotiationChannels;
 
 XrInstance gMainSessionInstance;
 MainSessionContext::Ptr gMainSessionContext;
+std::atomic<uint64_t> gMainFrameTickSequence = 0;
+thread_local FrameTimingScope* FrameTimingScope::current = nullptr;
 DWORD gMainProcessId;   // Set by Overlay to check for main process unexpected exit
 HANDLE gMainMutexHandle; // Held by Main for duration of operation as Main Session
 
@@ -1481,22 +2840,46 @@ bool OpenRPCChannels(XrInstance instance, DWORD otherProcessId, DWORD overlayId,
 
 
 std::unordered_map<DWORD, ConnectionToOverlay::Ptr> gConnectionsToOverlayByProcessId;
-std::vector<ConnectionToOverlay::Ptr> gConnectionsToOverlayInDepthOrder;
 std::recursive_mutex gConnectionsToOverlayByProcessIdMutex;
 
-// Assumes exclusive access to parameters, so lock around this if necessary
-void SortOverlaysByPriority(const std::unordered_map<DWORD, ConnectionToOverlay::Ptr>& connectionsToOverlayByProcessId, 
-    std::vector<ConnectionToOverlay::Ptr>& connectionsToOverlayInDepthOrder)
+// Overlays with sessions, ordered by sessionLayersPlacement (creation order
+// within the same placement).  The list is immutable once published; writers
+// copy, modify, and atomically swap it under
+// gConnectionsToOverlayByProcessIdMutex, and readers just atomic_load it.
+struct OverlayInDepthOrder
 {
-    connectionsToOverlayInDepthOrder.clear();
-    for(auto [processId, conn]: connectionsToOverlayByProcessId) {
-        auto l = conn->GetLock();
-        if(conn->ctx) {
-            connectionsToOverlayInDepthOrder.push_back(conn);
-        }
-    }
+    uint32_t sessionLayersPlacement;
+    ConnectionToOverlay::Ptr connection;
+    MainAsOverlaySessionContext::Ptr ctx;
+};
+typedef std::vector<OverlayInDepthOrder> OverlaysInDepthOrder;
+std::shared_ptr<const OverlaysInDepthOrder> gOverlaysInDepthOrder = std::make_shared<const OverlaysInDepthOrder>();
+
+std::shared_ptr<const OverlaysInDepthOrder> GetOverlaysInDepthOrder()
+{
+    return std::atomic_load(&gOverlaysInDepthOrder);
+}
+
+void InsertOverlayInDepthOrder(ConnectionToOverlay::Ptr connection, MainAsOverlaySessionContext::Ptr ctx)
+{
+    std::unique_lock<std::recursive_mutex> m(gConnectionsToOverlayByProcessIdMutex);
+
+    auto updated = std::make_shared<OverlaysInDepthOrder>(*GetOverlaysInDepthOrder());
+    auto it = std::upper_bound(updated->begin(), updated->end(), ctx->sessionLayersPlacement,
+        [](uint32_t placement, const OverlayInDepthOrder& o){ return placement < o.sessionLayersPlacement; });
+    updated->insert(it, {ctx->sessionLayersPlacement, connection, ctx});
+
+    std::atomic_store(&gOverlaysInDepthOrder, std::shared_ptr<const OverlaysInDepthOrder>(std::move(updated)));
+}
+
+void RemoveOverlayFromDepthOrder(const ConnectionToOverlay::Ptr& connection)
+{
+    std::unique_lock<std::recursive_mutex> m(gConnectionsToOverlayByProcessIdMutex);
 
-    std::sort(connectionsToOverlayInDepthOrder.begin(), connectionsToOverlayInDepthOrder.end(), [](const ConnectionToOverlay::Ptr &a, const ConnectionToOverlay::Ptr &b){ auto la = a->GetLock(); auto la2 = a->ctx->GetLock(); auto lb = b->GetLock(); auto lb2 = b->ctx->GetLock(); return a->ctx->sessionLayersPlacement < b->ctx->sessionLayersPlacement; });
+    auto updated = std::make_shared<OverlaysInDepthOrder>(*GetOverlaysInDepthOrder());
+    updated->erase(std::remove_if(updated->begin(), updated->end(), [&connection](const OverlayInDepthOrder& o){ return o.connection == connection; }), updated->end());
+
+    std::atomic_store(&gOverlaysInDepthOrder, std::shared_ptr<const OverlaysInDepthOrder>(std::move(updated)));
 }
 
 
@@ -1521,6 +2904,22 @@ const T* FindStructInChain(const void *head, XrStructureType type)
     return nullptr;
 }
 
+// Unlinks and frees the first structure of "type" from a chain we copied ourselves
+static void RemoveStructFromChain(XrInstance instance, void *head, XrStructureType type)
+{
+    auto prev = reinterpret_cast<XrBaseInStructure*>(head);
+    while(prev->next && (prev->next->type != type)) {
+        prev = const_cast<XrBaseInStructure*>(prev->next);
+    }
+    if(!prev->next) {
+        return;
+    }
+    auto found = const_cast<XrBaseInStructure*>(prev->next);
+    prev->next = found->next;
+    found->next = nullptr;
+    FreeXrStructChainWithFree(instance, found);
+}
+
 bool FindExtensionInList(const char* extension, uint32_t extensionsCount, const char * const* extensions)
 {
     for(uint32_t i = 0; i < extensionsCount; i++) {
@@ -1566,6 +2965,10 @@ XrResult OverlaysLayerCreateSessionMainAsOverlay(ConnectionToOverlay::Ptr connec
 
             // XXX Check out all other GAPI structs as support for them is added
 
+            case XR_TYPE_GRAPHICS_BINDING_CPU_EXTX:
+                // Overlay's images are shared memory; Main copies them into its own D3D11 images
+                break;
+
             case XR_TYPE_SESSION_CREATE_INFO_OVERLAY_EXTX:
                 // This is fine, ignore.  We could probably remove it on the Overlay side and not pass it through...
                 break;
@@ -1633,11 +3036,13 @@ XrResult OverlaysLayerCreateSessionMainAsOverlay(ConnectionToOverlay::Ptr connec
         return XR_ERROR_INITIALIZATION_FAILED;
     }
 
+    bool cpuImages = FindStructInChain<XrGraphicsBindingCpuEXTX>(createInfo->next, XR_TYPE_GRAPHICS_BINDING_CPU_EXTX) != nullptr;
+    auto ctx = std::make_shared<MainAsOverlaySessionContext>(createInfoOverlay, cpuImages ? SWAPCHAIN_IMAGE_BACKEND_CPU : SWAPCHAIN_IMAGE_BACKEND_D3D11);
     {
         auto l = connection->GetLock();
-        connection->ctx = std::make_shared<MainAsOverlaySessionContext>(createInfoOverlay);
-        SortOverlaysByPriority(gConnectionsToOverlayByProcessId, gConnectionsToOverlayInDepthOrder);
+        connection->ctx = ctx;
     }
+    InsertOverlayInDepthOrder(connection, ctx);
 
     *session = mainSession;
 
@@ -1689,8 +3094,19 @@ void MainRPCThreadBody(ConnectionToOverlay::Ptr connection, DWORD overlayProcess
     {
         std::unique_lock<std::recursive_mutex> m(gConnectionsToOverlayByProcessIdMutex);
         gConnectionsToOverlayByProcessId.erase(connection->conn.otherProcessId);
-        SortOverlaysByPriority(gConnectionsToOverlayByProcessId, gConnectionsToOverlayInDepthOrder);
     }
+    RemoveOverlayFromDepthOrder(connection);
+
+    // EndFrameMain may still be merging this overlay's layers; the session
+    // context (and the spaces and swapchains it removes) is freed by the
+    // reclaimer once those readers are done rather than here.
+    {
+        auto l = connection->GetLock();
+        OverlaysLayerRetire(std::move(connection->ctx));
+    }
+    OverlaysLayerRetire(std::move(connection));
+
+    OverlaysLayerLogHandleInfoCounts(gMainSessionInstance, "xrDestroySession");
 }
 
 void MainNegotiateThreadBody()
@@ -1761,10 +3177,20 @@ void MainNegotiateThreadBody()
     }
 }
 
-bool CreateMainSessionNegotiateThread(XrInstance instance, XrSession hostingSession)
+bool CreateMainSessionNegotiateThread(XrInstance instance, XrSession hostingSession, ID3D11Device* d3d11Device)
 {
     gMainSessionInstance = instance;
     gMainSessionContext = std::make_shared<MainSessionContext>(hostingSession);
+    {
+        // Stopped when Main's session is destroyed
+        auto imageCopies = std::make_shared<MainImageCopyQueue>(d3d11Device);
+        imageCopies->Start();
+        gMainSessionContext->imageCopies = imageCopies;
+    }
+    {
+        OverlaysLayerXrInstanceHandleInfo::Ptr instanceInfo = OverlaysLayerGetHandleInfoFromXrInstance(instance);
+        gMainSessionContext->colorScaleBiasEnabled = FindExtensionInList(XR_KHR_COMPOSITION_LAYER_COLOR_SCALE_BIAS_EXTENSION_NAME, instanceInfo->createInfo->enabledExtensionCount, instanceInfo->createInfo->enabledExtensionNames);
+    }
     if(!OpenNegotiationChannels(instance, gNegotiationChannels)) {
         OverlaysLayerLogMessage(instance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrCreateSession",
             OverlaysLayerNoObjectInfo, fmt("Could not create overlays negotiation channels").c_str());
@@ -1870,13 +3296,21 @@ XrResult OverlaysLayerCreateSessionMain(XrInstance instance, const XrSessionCrea
     OverlaysLayerAddHandleInfoForXrSession(localHandle, info);
     instanceInfo->childSessions.insert(info);
 
-    bool result = CreateMainSessionNegotiateThread(instance, localHandle);
+    bool result = CreateMainSessionNegotiateThread(instance, localHandle, d3d11Device);
 
     if(!result) {
         OverlaysLayerLogMessage(instance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrCreateSession", 
             OverlaysLayerNoObjectInfo, fmt("Could not initialize the Main App listener thread.").c_str());
         return XR_ERROR_INITIALIZATION_FAILED;
     }
+
+    XrSystemProperties systemProperties { XR_TYPE_SYSTEM_PROPERTIES };
+    if(XR_SUCCEEDED(instanceInfo->downchain->GetSystemProperties(instance, createInfo->systemId, &systemProperties))) {
+        gMainSessionContext->maxLayerCount = systemProperties.graphicsProperties.maxLayerCount;
+    } else {
+        OverlaysLayerLogMessage(instance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT, "xrCreateSession", 
+            OverlaysLayerNoObjectInfo, fmt("Could not get system properties; assuming maxLayerCount is %d.", XR_MIN_COMPOSITION_LAYERS_SUPPORTED).c_str());
+    }
     return xrresult;
 }
 
@@ -1947,10 +3381,22 @@ XrResult OverlaysLayerCreateSessionOverlay(
     const XrSessionCreateInfo*                  createInfo,
     XrSession*                                  session,
     const XrSessionCreateInfoOverlayEXTX*       createInfoOverlay,
-    ID3D11Device*   d3d11Device)
+    const XrBaseInStructure*                    graphicsBinding)
 {
     XrResult result = XR_SUCCESS;
 
+    ID3D11Device* d3d11Device = nullptr;
+    SwapchainImageBackend imageBackend;
+    switch(graphicsBinding->type) {
+        case XR_TYPE_GRAPHICS_BINDING_D3D11_KHR:
+            d3d11Device = reinterpret_cast<const XrGraphicsBindingD3D11KHR*>(graphicsBinding)->device;
+            imageBackend = SWAPCHAIN_IMAGE_BACKEND_D3D11;
+            break;
+        default:
+            imageBackend = SWAPCHAIN_IMAGE_BACKEND_CPU;
+            break;
+    }
+
     // Only on Overlay XrSession Creation, connect to the main app.
     if(!ConnectToMain(instance)) {
         OverlaysLayerLogMessage(gNegotiationChannels.instance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrCreateSession",
@@ -2014,6 +3460,10 @@ XrResult OverlaysLayerCreateSessionOverlay(
     info->localHandle = *session;
     info->isProxied = true;
     info->d3d11Device = d3d11Device;
+    info->imageBackend = imageBackend;
+    if((imageBackend == SWAPCHAIN_IMAGE_BACKEND_D3D11) && (gSharedTexturePoolBytes > 0)) {
+        info->texturePool = std::make_shared<SharedTexturePool>(gSharedTexturePoolBytes);
+    }
 
     for(XrPath p: instanceInfo->OverlaysLayerAllSubactionPaths) {
         info->currentInteractionProfileBySubactionPath.insert({p, XR_NULL_PATH});
@@ -2034,6 +3484,7 @@ XrResult OverlaysLayerCreateSession(XrInstance instance, const XrSessionCreateIn
         const XrBaseInStructure* p = reinterpret_cast<const XrBaseInStructure*>(createInfo->next);
         const XrSessionCreateInfoOverlayEXTX* cio = nullptr;
         const XrGraphicsBindingD3D11KHR* d3dbinding = nullptr;
+        const XrBaseInStructure* overlayBinding = nullptr;  // any binding an overlay can use
         while(p) {
             if(p->type == XR_TYPE_SESSION_CREATE_INFO_OVERLAY_EXTX) {
                 cio = reinterpret_cast<const XrSessionCreateInfoOverlayEXTX*>(p);
@@ -2052,17 +3503,26 @@ XrResult OverlaysLayerCreateSession(XrInstance instance, const XrSessionCreateIn
             }
             if(p->type == XR_TYPE_GRAPHICS_BINDING_D3D11_KHR) {
                 d3dbinding = reinterpret_cast<const XrGraphicsBindingD3D11KHR*>(p);
+                overlayBinding = p;
+            }
+            if(p->type == XR_TYPE_GRAPHICS_BINDING_CPU_EXTX) {
+                overlayBinding = p;
             }
             p = reinterpret_cast<const XrBaseInStructure*>(p->next);
         }
 
+        // Main composites into the runtime's D3D11 images; only an overlay can use CPU images
+        if(!d3dbinding && (!cio || !overlayBinding)) {
+            return XR_ERROR_GRAPHICS_DEVICE_INVALID;
+        }
+
         if(!cio) {
             if(PrintDebugInfo) OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT, "xrCreateSession", OverlaysLayerNoObjectInfo, "Creating Main Session");  // XXX DEBUG
             result = OverlaysLayerCreateSessionMain(instance, createInfo, session, d3dbinding->device);
             if(PrintDebugInfo) OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT, "xrCreateSession", OverlaysLayerNoObjectInfo, fmt("result of Create Main Session is %d, session is %08X", result, *session).c_str());  // XXX DEBUG
         } else {
             if(PrintDebugInfo) OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT, "xrCreateSession", OverlaysLayerNoObjectInfo, "Creating Overlay Session");  // XXX DEBUG
-            result = OverlaysLayerCreateSessionOverlay(instance, createInfo, session, cio, d3dbinding->device);
+            result = OverlaysLayerCreateSessionOverlay(instance, createInfo, session, cio, overlayBinding);
             if(PrintDebugInfo) OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT, "xrCreateSession", OverlaysLayerNoObjectInfo, fmt("result of Create Overlay Session is %d, session is %08X", result, *session).c_str());  // XXX DEBUG
         }
 
@@ -2124,12 +3584,24 @@ XrResult OverlaysLayerCreateSwapchainMainAsOverlay(ConnectionToOverlay::Ptr conn
     *swapchainCount = count;
 
     OverlaysLayerXrSwapchainHandleInfo::Ptr swapchainInfo = std::make_shared<OverlaysLayerXrSwapchainHandleInfo>(session, sessionInfo->parentInstance, sessionInfo->downchain);
-    swapchainInfo->mainAsOverlaySwapchain = std::make_shared<SwapchainCachedData>(*swapchain, swapchainTextures);
+    MainSwapchainImages::Ptr images;
+    if(connection->ctx->imageBackend == SWAPCHAIN_IMAGE_BACKEND_CPU) {
+        images = std::make_shared<CpuMainSwapchainImages>(sessionInfo->d3d11Device, swapchainTextures);
+    } else {
+        images = std::make_shared<D3D11MainSwapchainImages>(sessionInfo->d3d11Device, swapchainTextures);
+    }
+    swapchainInfo->mainAsOverlaySwapchain = std::make_shared<SwapchainCachedData>(*swapchain, images, gMainSessionContext->imageCopies, count, (int32_t)createInfo->width, (int32_t)createInfo->height);
     swapchainInfo->actualHandle = actualHandle;
     swapchainInfo->localHandle = localHandle;
 
     OverlaysLayerAddHandleInfoForXrSwapchain(*swapchain, swapchainInfo);
 
+    {
+        // Removed with the connection's context if the overlay never destroys it
+        auto l = connection->ctx->GetLock();
+        connection->ctx->localSwapchains.insert(*swapchain);
+    }
+
     return result;
 }
 
@@ -2139,6 +3611,19 @@ XrResult OverlaysLayerCreateSwapchainOverlay(XrInstance instance, XrSession sess
 
     uint32_t swapchainCount;
 
+    OverlaySwapchainImages::Ptr images;
+    if(sessionInfo->imageBackend == SWAPCHAIN_IMAGE_BACKEND_CPU) {
+        uint32_t bytesPerPixel = GetCpuImageBytesPerPixel(static_cast<DXGI_FORMAT>(createInfo->format));
+        if(bytesPerPixel == 0) {
+            OverlaysLayerLogMessage(instance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrCreateSwapchain",
+                OverlaysLayerNoObjectInfo, fmt("CPU swapchain images can't hold format %lld", createInfo->format).c_str());
+            return XR_ERROR_SWAPCHAIN_FORMAT_UNSUPPORTED;
+        }
+        images = std::make_shared<CpuOverlaySwapchainImages>(createInfo, bytesPerPixel);
+    } else {
+        images = std::make_shared<D3D11OverlaySwapchainImages>(sessionInfo->d3d11Device, createInfo, sessionInfo->texturePool);
+    }
+
     auto createInfoCopy = GetSharedCopyHandlesRestored(sessionInfo->parentInstance, "xrCreateSwapchain", createInfo);
 
     XrResult result = RPCCallCreateSwapchain(instance, sessionInfo->actualHandle, createInfoCopy.get(), swapchain, &swapchainCount);
@@ -2147,6 +3632,19 @@ XrResult OverlaysLayerCreateSwapchainOverlay(XrInstance instance, XrSession sess
         return result;
     }
 
+    if(sessionInfo->imageBackend == SWAPCHAIN_IMAGE_BACKEND_D3D11) {
+        // Render straight into Main's runtime images if Main can give them to us
+        std::vector<uint64_t> exported(swapchainCount);
+        uint32_t exportedCount;
+        if(RPCCallExportSwapchainImages(instance, *swapchain, swapchainCount, &exportedCount, exported.data()) == XR_SUCCESS) {
+            std::vector<HANDLE> handles;
+            for(uint32_t i = 0; i < exportedCount; i++) {
+                handles.push_back(reinterpret_cast<HANDLE>(exported[i]));
+            }
+            images = std::make_shared<ExportedOverlaySwapchainImages>(sessionInfo->d3d11Device, handles);
+        }
+    }
+
     XrSwapchain actualHandle = *swapchain;
     XrSwapchain localHandle = (XrSwapchain)GetNextLocalHandle();
     *swapchain = localHandle;
@@ -2162,15 +3660,20 @@ XrResult OverlaysLayerCreateSwapchainOverlay(XrInstance instance, XrSession sess
     swapchainInfo->localHandle = localHandle;
     swapchainInfo->isProxied = true;
 
-    OverlaySwapchain::Ptr overlaySwapchain = std::make_shared<OverlaySwapchain>(*swapchain, swapchainCount, createInfo);
+    OverlaySwapchain::Ptr overlaySwapchain = std::make_shared<OverlaySwapchain>(*swapchain, images, swapchainCount);
     swapchainInfo->overlaySwapchain = overlaySwapchain;
 
-    if(!overlaySwapchain->CreateTextures(instance, sessionInfo->d3d11Device, gConnectionToMain->conn.otherProcessId)) {
+    auto imagesStart = std::chrono::steady_clock::now();
+    if(!images->Create(instance, swapchainCount, gConnectionToMain->conn.otherProcessHandle)) {
         OverlaysLayerLogMessage(instance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrCreateSwapchain",
-            OverlaysLayerNoObjectInfo, "Couldn't create D3D local resources for swapchain images");
+            OverlaysLayerNoObjectInfo, "Couldn't create local resources for swapchain images");
         // XXX This leaks the session in main process if the Session is not closed.
         return XR_ERROR_INITIALIZATION_FAILED;
     }
+    // For comparing creation cost with and without OVERLAYS_API_LAYER_TEXTURE_POOL_MB
+    long long imagesMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - imagesStart).count();
+    OverlaysLayerLogMessage(instance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT, "xrCreateSwapchain",
+        OverlaysLayerNoObjectInfo, fmt("made %u swapchain images in %lld us", swapchainCount, imagesMicroseconds).c_str());
 
     OverlaysLayerAddHandleInfoForXrSwapchain(*swapchain, swapchainInfo);
 
@@ -2181,6 +3684,11 @@ XrResult OverlaysLayerDestroySwapchainMainAsOverlay(ConnectionToOverlay::Ptr con
 {
     OverlaysLayerXrSwapchainHandleInfo::Ptr swapchainInfo = OverlaysLayerGetHandleInfoFromXrSwapchain(swapchain);
 
+    {
+        auto l = connection->ctx->GetLock();
+        connection->ctx->localSwapchains.erase(swapchain);
+    }
+
     OverlaysLayerRemoveXrSwapchainHandleInfo(swapchain);
 
     // XXX anything here?  Need to manage error returns as if this was a runtime?  invalid handle will be caught by GetHandleInfo...
@@ -2227,6 +3735,12 @@ XrResult OverlaysLayerCreateReferenceSpaceMainAsOverlay(ConnectionToOverlay::Ptr
 
     OverlaysLayerAddHandleInfoForXrSpace(*space, spaceInfo);
 
+    {
+        // Removed with the connection's context if the overlay never destroys it
+        auto l = connection->ctx->GetLock();
+        connection->ctx->localSpaces.insert(*space);
+    }
+
     return result;
 }
 
@@ -2299,16 +3813,17 @@ XrResult OverlaysLayerLocateSpaceMainAsOverlay(ConnectionToOverlay::Ptr connecti
 
     XrResult result = XR_SUCCESS;
 
-    auto spaceInfo = OverlaysLayerGetHandleInfoFromXrSpace(space);
-    auto baseSpaceInfo = OverlaysLayerGetHandleInfoFromXrSpace(baseSpace);
-    auto sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(spaceInfo->parentHandle);
+    OverlaysLayerEpochGuard epochGuard;
+    auto spaceInfo = OverlaysLayerBorrowHandleInfoFromXrSpace(space);
+    auto baseSpaceInfo = OverlaysLayerBorrowHandleInfoFromXrSpace(baseSpace);
+    auto sessionInfo = OverlaysLayerBorrowHandleInfoFromXrSession(spaceInfo->parentHandle);
 
     if(spaceInfo->spaceType == SPACE_ACTION) {
 
 
         XrActiveActionSet activeActionSet { sessionInfo->placeholderActionSet, XR_NULL_PATH };
         XrActionsSyncInfo syncInfo { XR_TYPE_ACTIONS_SYNC_INFO, nullptr, 1, &activeActionSet };
-        auto sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(spaceInfo->parentHandle);
+        auto sessionInfo = OverlaysLayerBorrowHandleInfoFromXrSession(spaceInfo->parentHandle);
         {
             auto syncActionsLock = GetSyncActionsLock();
 
@@ -2402,8 +3917,9 @@ bool SynchronizeActionSpaceWithMain(XrInstance instance, XrSpace space)
 
 XrResult OverlaysLayerLocateSpaceOverlay(XrInstance instance, XrSpace space, XrSpace baseSpace, XrTime time, XrSpaceLocation* location)
 {
-    auto spaceInfo = OverlaysLayerGetHandleInfoFromXrSpace(space);
-    auto baseSpaceInfo = OverlaysLayerGetHandleInfoFromXrSpace(baseSpace);
+    OverlaysLayerEpochGuard epochGuard;
+    auto spaceInfo = OverlaysLayerBorrowHandleInfoFromXrSpace(space);
+    auto baseSpaceInfo = OverlaysLayerBorrowHandleInfoFromXrSpace(baseSpace);
 
     XrResult result;
 
@@ -2441,14 +3957,15 @@ XrResult OverlaysLayerLocateSpaceMain(XrInstance parentInstance, XrSpace space,
 
     XrResult result = XR_SUCCESS;
 
-    auto spaceInfo = OverlaysLayerGetHandleInfoFromXrSpace(space);
-    auto baseSpaceInfo = OverlaysLayerGetHandleInfoFromXrSpace(baseSpace);
-    auto sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(spaceInfo->parentHandle);
+    OverlaysLayerEpochGuard epochGuard;
+    auto spaceInfo = OverlaysLayerBorrowHandleInfoFromXrSpace(space);
+    auto baseSpaceInfo = OverlaysLayerBorrowHandleInfoFromXrSpace(baseSpace);
+    auto sessionInfo = OverlaysLayerBorrowHandleInfoFromXrSession(spaceInfo->parentHandle);
 
     if(spaceInfo->spaceType == SPACE_ACTION) {
 
         // Sync this Space's Action so it's active
-        auto actionSetInfo = OverlaysLayerGetHandleInfoFromXrActionSet(spaceInfo->action->parentHandle);
+        auto actionSetInfo = OverlaysLayerBorrowHandleInfoFromXrActionSet(spaceInfo->action->parentHandle);
         // XXX may need to keep XrActionsSyncInfo from previous xrSyncActions and play that back
         XrActiveActionSet activeActionSet { actionSetInfo->handle, spaceInfo->actionSpaceCreateInfo->subactionPath };
         XrActionsSyncInfo syncInfo { XR_TYPE_ACTIONS_SYNC_INFO, nullptr, 1, &activeActionSet };
@@ -2482,7 +3999,8 @@ XrResult OverlaysLayerLocateSpace(XrSpace space, XrSpace baseSpace, XrTime time,
 {
     try {
 
-        auto spaceInfo = OverlaysLayerGetHandleInfoFromXrSpace(space);
+        OverlaysLayerEpochGuard epochGuard;
+        auto spaceInfo = OverlaysLayerBorrowHandleInfoFromXrSpace(space);
 
         bool isProxied = spaceInfo->isProxied;
         XrResult result;
@@ -2515,6 +4033,11 @@ XrResult OverlaysLayerDestroySpaceMainAsOverlay(ConnectionToOverlay::Ptr connect
 
     // XXX This will need to be smart about ActionSpaces?
 
+    {
+        auto l = connection->ctx->GetLock();
+        connection->ctx->localSpaces.erase(space);
+    }
+
     OverlaysLayerRemoveXrSpaceHandleInfo(space);
 
     return XR_SUCCESS;
@@ -2648,33 +4171,19 @@ XrResult OverlaysLayerEnumerateSwapchainImagesOverlay(
 {
     OverlaysLayerXrSwapchainHandleInfo::Ptr swapchainInfo = OverlaysLayerGetHandleInfoFromXrSwapchain(swapchain);
 
-    auto& overlaySwapchain = swapchainInfo->overlaySwapchain;
+    auto& overlayImages = swapchainInfo->overlaySwapchain->images;
 
     if(imageCapacityInput == 0) {
-        *imageCountOutput = (uint32_t)overlaySwapchain->swapchainTextures.size();
+        *imageCountOutput = overlayImages->GetCount();
         return XR_SUCCESS;
     }
 
-    if(images[0].type != XR_TYPE_SWAPCHAIN_IMAGE_D3D11_KHR) {
-        OverlaysLayerXrInstanceHandleInfo::Ptr info = OverlaysLayerGetHandleInfoFromXrInstance(instance);
-
-        char structTypeName[XR_MAX_STRUCTURE_NAME_SIZE];
-        structTypeName[0] = '\0';
-        if(info->downchain->StructureTypeToString(instance, images[0].type, structTypeName) != XR_SUCCESS) {
-            sprintf(structTypeName, "<type %08X>", images[0].type);
-        }
-        OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrEnumerateSwapchainImages",
-            OverlaysLayerNoObjectInfo, fmt("images structure type is %s and not XR_TYPE_SWAPCHAIN_IMAGE_D3D11_KHR.", structTypeName).c_str());
+    // (If storage is provided) Give back the "local" swapchainimages for rendering
+    uint32_t toWrite = std::min(imageCapacityInput, overlayImages->GetCount());
+    if(!overlayImages->GetImages(instance, toWrite, images)) {
         return XR_ERROR_VALIDATION_FAILURE;
     }
 
-    // (If storage is provided) Give back the "local" swapchainimages (rendertarget) for rendering
-    auto sci = reinterpret_cast<XrSwapchainImageD3D11KHR*>(images);
-    uint32_t toWrite = std::min(imageCapacityInput, (uint32_t)overlaySwapchain->swapchainTextures.size());
-    for(uint32_t i = 0; i < toWrite; i++) {
-        sci[i].texture = overlaySwapchain->swapchainTextures[i];
-    }
-
     *imageCountOutput = toWrite;
 
     return XR_SUCCESS;
@@ -2687,9 +4196,8 @@ XrResult OverlaysLayerPollEventMainAsOverlay(ConnectionToOverlay::Ptr connection
 
     OptionalSessionStateChange pendingStateChange;
     {
+        // State words are updated with CAS; no session or context locks needed
         MainSessionContext::Ptr mainSessionContext = gMainSessionContext;
-        auto l = mainSessionContext->GetLock();
-        auto l2 = connection->ctx->GetLock();
         pendingStateChange = connection->ctx->sessionState.GetAndDoPendingStateChange(&mainSessionContext->sessionState);
     }
 
@@ -2836,7 +4344,6 @@ XrResult OverlaysLayerPollEvent(XrInstance instance, XrEventDataBuffer* eventDat
                 // XXX ignores any chained event data
                 const auto* ssc = reinterpret_cast<const XrEventDataSessionStateChanged*>(eventData);
                 MainSessionContext::Ptr mainSessionContext = gMainSessionContext;
-                auto l = mainSessionContext->GetLock();
                 mainSessionContext->sessionState.DoStateChange(ssc->state, ssc->time);
 
                 if(ssc->next) {
@@ -2891,7 +4398,6 @@ XrResult OverlaysLayerBeginSessionMainAsOverlay(ConnectionToOverlay::Ptr connect
     auto l = connection->GetLock();
     // auto beginInfoCopy = GetSharedCopyHandlesRestored(sessionInfo->parentInstance, "xrCreateSwapchain", beginInfo);
 
-    auto l2 = connection->ctx->GetLock();
     connection->ctx->sessionState.DoCommand(OpenXRCommand::BEGIN_SESSION);
 
     return XR_SUCCESS;
@@ -2917,11 +4423,12 @@ XrResult OverlaysLayerRequestExitSessionMainAsOverlay(ConnectionToOverlay::Ptr c
     OverlaysLayerXrSessionHandleInfo::Ptr sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(session);
 
     auto l = connection->GetLock();
-    auto l2 = connection->ctx->GetLock();
-    if(!connection->ctx->sessionState.isRunning) {
+    auto [requested, state] = connection->ctx->sessionState.Update([](SessionStateWord& s){
+        return s.isRunning && SessionStateTracker::ApplyCommand(s, OpenXRCommand::REQUEST_EXIT_SESSION);
+    });
+    if(!requested) {
         return XR_ERROR_SESSION_NOT_RUNNING;
     }
-    connection->ctx->sessionState.DoCommand(OpenXRCommand::REQUEST_EXIT_SESSION);
 
     return XR_SUCCESS;
 }
@@ -2944,14 +4451,15 @@ XrResult OverlaysLayerEndSessionMainAsOverlay(ConnectionToOverlay::Ptr connectio
     OverlaysLayerXrSessionHandleInfo::Ptr sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(session);
 
     auto l = connection->GetLock();
-    auto l2 = connection->ctx->GetLock();
-
-    if(connection->ctx->sessionState.sessionState != XR_SESSION_STATE_STOPPING) {
+    auto [ended, state] = connection->ctx->sessionState.Update([](SessionStateWord& s){
+        return (s.sessionState == XR_SESSION_STATE_STOPPING) && SessionStateTracker::ApplyCommand(s, OpenXRCommand::END_SESSION);
+    });
+    if(!ended) {
         return XR_ERROR_SESSION_NOT_STOPPING;
     }
 
-    connection->ctx->sessionState.DoCommand(OpenXRCommand::END_SESSION);
-    connection->ctx->overlayLayers.clear();
+    connection->ctx->overlayLayers.GetWriteBuffer().clear();
+    connection->ctx->overlayLayers.Publish();
 
     return XR_SUCCESS;
 }
@@ -2971,23 +4479,63 @@ XrResult OverlaysLayerEndSessionOverlay(XrInstance instance, XrSession session)
 
 XrResult OverlaysLayerWaitFrameMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSession session, const XrFrameWaitInfo* frameWaitInfo, XrFrameState* frameState)
 {
-	{
-		auto l = connection->GetLock();
-		auto l2 = connection->ctx->GetLock();
+    MainAsOverlaySessionContext::Ptr ctx;
+    uint64_t lastSequence;
+    uint64_t renderSequence;
+    XrTime lastDisplayTime;
+    bool block;
+    {
+        auto l = connection->GetLock();
+        ctx = connection->ctx;
+        auto l2 = ctx->GetLock();
+        lastSequence = ctx->lastFrameTickSequence;
+        renderSequence = ctx->nextRenderSequence;
+        lastDisplayTime = ctx->lastPredictedDisplayTime;
+        block = !ctx->relaxedDisplayTime;
+    }
+    uint32_t frameInterval = ctx->frameInterval;
+
+    FrameTimingScope frameTiming(&ctx->frameTimings, XR_FRAME_TIMING_PHASE_WAIT_FRAME_EXTX);
 
-		if (!connection->ctx->relaxedDisplayTime) {
-			// XXX tell main we are waiting by setting a variable in ctx and then wait on a semaphore
-		}
-	}
-    
     auto mainSession = gMainSessionContext;
-    auto lock2 = mainSession->GetLock();
+    if(!mainSession) {
+        return XR_ERROR_SESSION_LOST;
+    }
+
+    // Block outside all locks so Main's xrWaitFrame can publish the next tick.
+    FrameTimingScope::DownchainBegin();
+    MainSessionSessionState::FrameTick tick = mainSession->sessionState.WaitFrameTick(lastSequence, block);
+
+    // A decimated overlay sleeps through Main's frames until its next update is due,
+    // unless Main stops ticking, in which case it gets shouldRender false instead of hanging.
+    while(block && (tick.sequence < renderSequence)) {
+        MainSessionSessionState::FrameTick next = mainSession->sessionState.WaitFrameTick(tick.sequence, true);
+        if(next.sequence == tick.sequence) {
+            break;
+        }
+        tick = next;
+    }
+    FrameTimingScope::DownchainEnd();
+    bool renderDue = tick.sequence >= renderSequence;
+
     // XXX this is incomplete; need to descend next chain and copy as possible from saved requirements.
-    frameState->predictedDisplayTime = mainSession->sessionState.savedFrameState->predictedDisplayTime;
-    frameState->predictedDisplayPeriod = mainSession->sessionState.savedFrameState->predictedDisplayPeriod;
-    frameState->shouldRender = mainSession->sessionState.savedFrameState->shouldRender;
+    frameState->predictedDisplayTime = tick.predictedDisplayTime;
+    frameState->predictedDisplayPeriod = tick.predictedDisplayPeriod * frameInterval;
+    frameState->shouldRender = tick.shouldRender && renderDue;
+
+    // Relaxed overlays (or a timed-out wait) may see the same tick again; keep display time moving forward
+    if(frameState->predictedDisplayTime <= lastDisplayTime) {
+        frameState->predictedDisplayTime = lastDisplayTime + std::max<XrDuration>(tick.predictedDisplayPeriod, 1);
+    }
 
-    mainSession->sessionState.IncrementPredictedDisplayTime();
+    {
+        auto l2 = ctx->GetLock();
+        ctx->lastFrameTickSequence = tick.sequence;
+        ctx->lastPredictedDisplayTime = frameState->predictedDisplayTime;
+        if(renderDue) {
+            ctx->nextRenderSequence = tick.sequence + frameInterval;
+        }
+    }
 
     return XR_SUCCESS;
 }
@@ -3014,6 +4562,8 @@ XrResult OverlaysLayerBeginFrameMainAsOverlay(ConnectionToOverlay::Ptr connectio
 
     auto l = connection->GetLock();
 
+    FrameTimingScope frameTiming(&connection->ctx->frameTimings, XR_FRAME_TIMING_PHASE_BEGIN_FRAME_EXTX);
+
     // At this time xrBeginFrame has no inputs and returns nothing.
     //auto beginInfoCopy = GetSharedCopyHandlesRestored(sessionInfo->parentInstance, "xrBeginFrame", beginInfo);
 
@@ -3040,6 +4590,15 @@ XrResult OverlaysLayerAcquireSwapchainImageMainAsOverlay(ConnectionToOverlay::Pt
     auto synchronizeEveryProcLock = gSynchronizeEveryProc ? std::unique_lock<std::recursive_mutex>(gSynchronizeEveryProcMutex) : std::unique_lock<std::recursive_mutex>();
 
     OverlaysLayerXrSwapchainHandleInfo::Ptr swapchainInfo = OverlaysLayerGetHandleInfoFromXrSwapchain(swapchain);
+    auto& mainAsOverlaySwapchain = swapchainInfo->mainAsOverlaySwapchain;
+
+    // The runtime sees this swapchain's calls in the order the overlay made them
+    mainAsOverlaySwapchain->copyQueue->WaitFor(mainAsOverlaySwapchain->lastCopyQueued);
+
+    XrResult releaseFailure = mainAsOverlaySwapchain->releaseFailure.exchange(XR_SUCCESS);
+    if(releaseFailure != XR_SUCCESS) {
+        return releaseFailure;
+    }
 
     auto acquireInfoCopy = GetSharedCopyHandlesRestored(swapchainInfo->parentInstance, "xrAcquireSwapchainImage", acquireInfo);
 
@@ -3049,7 +4608,14 @@ XrResult OverlaysLayerAcquireSwapchainImageMainAsOverlay(ConnectionToOverlay::Pt
         return result;
     }
 
-    swapchainInfo->mainAsOverlaySwapchain->acquired.push_back(*index);
+    // The runtime should have refused an acquire past the image count or of an image not yet released
+    auto& imageState = mainAsOverlaySwapchain->imageState;
+    if((*index >= imageState.size()) || (imageState[*index] & SWAPCHAIN_IMAGE_STATE_ACQUIRED_BIT) || !mainAsOverlaySwapchain->acquired.Push(*index)) {
+        OverlaysLayerLogMessage(swapchainInfo->parentInstance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrAcquireSwapchainImage",
+            OverlaysLayerNoObjectInfo, fmt("runtime returned image %u, which is out of range or already acquired", *index).c_str());
+        return XR_ERROR_RUNTIME_FAILURE;
+    }
+    imageState[*index] |= SWAPCHAIN_IMAGE_STATE_ACQUIRED_BIT;
 
     return result;
 }
@@ -3066,16 +4632,50 @@ XrResult OverlaysLayerAcquireSwapchainImageOverlay(XrInstance instance, XrSwapch
         return result;
     }
 
-    swapchainInfo->overlaySwapchain->acquired.push_back(*index);
+    if(!swapchainInfo->overlaySwapchain->acquired.Push(*index)) {
+        return XR_ERROR_CALL_ORDER_INVALID;
+    }
 
     return result;
 }
 
-XrResult OverlaysLayerWaitSwapchainImageMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSwapchain swapchain, const XrSwapchainImageWaitInfo* waitInfo, HANDLE sourceImage)
+XrResult OverlaysLayerWaitSwapchainImageMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSwapchain swapchain, const XrSwapchainImageWaitInfo* waitInfo, HANDLE sourceImage, HANDLE sourceSync)
 {
     auto synchronizeEveryProcLock = gSynchronizeEveryProc ? std::unique_lock<std::recursive_mutex>(gSynchronizeEveryProcMutex) : std::unique_lock<std::recursive_mutex>();
 
     OverlaysLayerXrSwapchainHandleInfo::Ptr swapchainInfo = OverlaysLayerGetHandleInfoFromXrSwapchain(swapchain);
+    auto& mainAsOverlaySwapchain = swapchainInfo->mainAsOverlaySwapchain;
+
+    // The previous release's copy must be done with the images before one is handed back
+    mainAsOverlaySwapchain->copyQueue->WaitFor(mainAsOverlaySwapchain->lastCopyQueued);
+
+    XrResult releaseFailure = mainAsOverlaySwapchain->releaseFailure.exchange(XR_SUCCESS);
+    if(releaseFailure != XR_SUCCESS) {
+        return releaseFailure;
+    }
+
+    if(mainAsOverlaySwapchain->acquired.Empty()) {
+        return XR_ERROR_CALL_ORDER_INVALID;
+    }
+    uint32_t which = mainAsOverlaySwapchain->acquired.Front();
+    uint8_t& state = mainAsOverlaySwapchain->imageState[which];
+    if(!mainAsOverlaySwapchain->images->OpenSourceImage(which, sourceImage, sourceSync)) {
+        return XR_ERROR_RUNTIME_FAILURE;
+    }
+
+    // Main never took this image when the overlay last released it.  Take it
+    // now so it can be handed back; until then the overlay can only retry.
+    // Not waited for, since this thread holds gSynchronizeEveryProcMutex.
+    if(state & SWAPCHAIN_IMAGE_STATE_STALLED_BIT) {
+        SwapchainImageHandoff handoff = mainAsOverlaySwapchain->images->Acquire(which, SWAPCHAIN_IMAGE_OWNER_MAIN, 0);
+        if(handoff == SWAPCHAIN_IMAGE_HANDOFF_TIMEOUT) {
+            return XR_TIMEOUT_EXPIRED;
+        }
+        if(handoff == SWAPCHAIN_IMAGE_HANDOFF_FAILED) {
+            return XR_ERROR_RUNTIME_FAILURE;
+        }
+        state = (state & ~SWAPCHAIN_IMAGE_STATE_STALLED_BIT) | SWAPCHAIN_IMAGE_STATE_HELD_BIT;
+    }
 
     auto waitInfoCopy = GetSharedCopyHandlesRestored(swapchainInfo->parentInstance, "xrWaitSwapchainImage", waitInfo);
 
@@ -3085,28 +4685,9 @@ XrResult OverlaysLayerWaitSwapchainImageMainAsOverlay(ConnectionToOverlay::Ptr c
         return result;
     }
 
-    auto& mainAsOverlaySwapchain = swapchainInfo->mainAsOverlaySwapchain;
-    if(mainAsOverlaySwapchain->remoteImagesAcquired.find(sourceImage) != mainAsOverlaySwapchain->remoteImagesAcquired.end()) {
-        IDXGIKeyedMutex* keyedMutex;
-        {
-            ID3D11Device* d3d11Device;
-            {
-                OverlaysLayerXrSessionHandleInfo::Ptr sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(swapchainInfo->parentHandle);
-                d3d11Device = sessionInfo->d3d11Device;
-            }
-
-            ID3D11Texture2D *sharedTexture = mainAsOverlaySwapchain->getSharedTexture(d3d11Device, sourceImage);
-            HRESULT result = sharedTexture->QueryInterface( __uuidof(IDXGIKeyedMutex), (LPVOID*)&keyedMutex);
-            if(result != S_OK) {
-                LogWindowsError(result, "xrWaitSwapchainImage", "QueryInterface", __FILE__, __LINE__);
-                return XR_ERROR_RUNTIME_FAILURE;
-            }
-        }
-        mainAsOverlaySwapchain->remoteImagesAcquired.erase(sourceImage);
-        HRESULT result = keyedMutex->ReleaseSync(SwapchainCachedData::KEYED_MUTEX_OVERLAY);
-        keyedMutex->Release();
-        if(result != S_OK) {
-            LogWindowsError(result, "xrWaitSwapchainImage", "ReleaseSync", __FILE__, __LINE__);
+    if(state & SWAPCHAIN_IMAGE_STATE_HELD_BIT) {
+        state &= ~SWAPCHAIN_IMAGE_STATE_HELD_BIT;
+        if(!mainAsOverlaySwapchain->images->Release(which, SWAPCHAIN_IMAGE_OWNER_OVERLAY)) {
             return XR_ERROR_RUNTIME_FAILURE;
         }
     }
@@ -3124,177 +4705,397 @@ XrResult OverlaysLayerWaitSwapchainImageOverlay(XrInstance instance, XrSwapchain
 
     auto& overlaySwapchain = swapchainInfo->overlaySwapchain;
 
-    uint32_t wasWaited = overlaySwapchain->acquired[0];
-    HANDLE sourceImage = overlaySwapchain->swapchainHandles[wasWaited];
+    if(overlaySwapchain->acquired.Empty()) {
+        return XR_ERROR_CALL_ORDER_INVALID;
+    }
+    uint32_t wasWaited = overlaySwapchain->acquired.Front();
+    HANDLE sourceImage = overlaySwapchain->images->GetSharedHandle(wasWaited);
+    HANDLE sourceSync = overlaySwapchain->images->GetSharedSyncHandle(wasWaited);
 
-    auto waitInfoCopy = GetSharedCopyHandlesRestored(swapchainInfo->parentInstance, "xrWaitSwapchainImage", waitInfo);
+    XrResult result = XR_SUCCESS;
 
-    XrResult result = RPCCallWaitSwapchainImage(instance, swapchainInfo->actualHandle, waitInfoCopy.get(), sourceImage);
+    // A retry after our own handoff timed out mustn't wait on the runtime image again
+    if(!overlaySwapchain->remoteWaited) {
+        auto waitInfoCopy = GetSharedCopyHandlesRestored(swapchainInfo->parentInstance, "xrWaitSwapchainImage", waitInfo);
 
-    if(!XR_SUCCEEDED(result)) {
-        return result;
+        result = RPCCallWaitSwapchainImage(instance, swapchainInfo->actualHandle, waitInfoCopy.get(), sourceImage, sourceSync);
+
+        if(!XR_SUCCEEDED(result) || (result == XR_TIMEOUT_EXPIRED)) {
+            return result;
+        }
+        overlaySwapchain->remoteWaited = true;
+    }
+
+    DWORD timeoutMs = INFINITE;
+    if(waitInfo->timeout != XR_INFINITE_DURATION) {
+        timeoutMs = (DWORD)std::min<XrDuration>((std::max<XrDuration>(waitInfo->timeout, 0) + 999999) / 1000000, INFINITE - 1);
+    }
+    SwapchainImageHandoff handoff = overlaySwapchain->images->Acquire(wasWaited, SWAPCHAIN_IMAGE_OWNER_OVERLAY, timeoutMs);
+    if(handoff == SWAPCHAIN_IMAGE_HANDOFF_TIMEOUT) {
+        return XR_TIMEOUT_EXPIRED;
+    }
+    if(handoff == SWAPCHAIN_IMAGE_HANDOFF_FAILED) {
+        return XR_ERROR_RUNTIME_FAILURE;
     }
 
+    overlaySwapchain->remoteWaited = false;
     overlaySwapchain->waited = true;
-    IDXGIKeyedMutex* keyedMutex;
-    HRESULT hresult;
 
-    hresult = overlaySwapchain->swapchainTextures[wasWaited]->QueryInterface( __uuidof(IDXGIKeyedMutex), (LPVOID*)&keyedMutex);
-    if(hresult != S_OK) {
-        LogWindowsError(result, "xrWaitSwapchainImage", "QueryInterface", __FILE__, __LINE__);
+    return result;
+}
+
+XrResult OverlaysLayerReleaseSwapchainImageMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSwapchain swapchain, const XrSwapchainImageReleaseInfo* releaseInfo, HANDLE sourceImage, HANDLE sourceSync)
+{
+    auto synchronizeEveryProcLock = gSynchronizeEveryProc ? std::unique_lock<std::recursive_mutex>(gSynchronizeEveryProcMutex) : std::unique_lock<std::recursive_mutex>();
+
+    OverlaysLayerXrSwapchainHandleInfo::Ptr swapchainInfo = OverlaysLayerGetHandleInfoFromXrSwapchain(swapchain);
+
+    auto& mainAsOverlaySwapchain = swapchainInfo->mainAsOverlaySwapchain;
+
+    if(mainAsOverlaySwapchain->acquired.Empty()) {
+        return XR_ERROR_CALL_ORDER_INVALID;
+    }
+    uint32_t which = mainAsOverlaySwapchain->acquired.Front();
+    uint8_t& state = mainAsOverlaySwapchain->imageState[which];
+    if(!mainAsOverlaySwapchain->images->OpenSourceImage(which, sourceImage, sourceSync)) {
         return XR_ERROR_RUNTIME_FAILURE;
     }
-    hresult = keyedMutex->AcquireSync(SwapchainCachedData::KEYED_MUTEX_OVERLAY, INFINITE); // XXX INFINITE timeout
-    keyedMutex->Release();
-    if(hresult != S_OK) {
-        LogWindowsError(result, "xrWaitSwapchainImage", "AcquireSync", __FILE__, __LINE__);
+
+    // Only tried here; this thread holds gSynchronizeEveryProcMutex, so if the
+    // overlay still has the image the copy queue tries once more, and if that
+    // fails too, releases the runtime image uncopied and xrEndFrame withholds
+    // the layers showing this swapchain until a later release is copied
+    SwapchainImageHandoff handoff = mainAsOverlaySwapchain->images->Acquire(which, SWAPCHAIN_IMAGE_OWNER_MAIN, 0);
+    if(handoff == SWAPCHAIN_IMAGE_HANDOFF_FAILED) {
+        return XR_ERROR_RUNTIME_FAILURE;
+    }
+
+    mainAsOverlaySwapchain->acquired.Pop();
+    state &= ~SWAPCHAIN_IMAGE_STATE_ACQUIRED_BIT;
+
+    bool handedOff = (handoff == SWAPCHAIN_IMAGE_HANDOFF_DONE);
+    state |= handedOff ? SWAPCHAIN_IMAGE_STATE_HELD_BIT : SWAPCHAIN_IMAGE_STATE_STALLED_BIT;
+    mainAsOverlaySwapchain->releaseCount++;
+
+    mainAsOverlaySwapchain->AddDirtyRects(FindStructInChain<XrSwapchainImageDirtyRectsEXTX>(releaseInfo->next, XR_TYPE_SWAPCHAIN_IMAGE_DIRTY_RECTS_EXTX));
+    SwapchainImageDirtyRegion region = mainAsOverlaySwapchain->TakeDirtyRegion(which);
+
+    auto releaseInfoCopy = GetSharedCopyHandlesRestored(swapchainInfo->parentInstance, "xrReleaseSwapchainImage", releaseInfo);
+    RemoveStructFromChain(swapchainInfo->parentInstance, releaseInfoCopy.get(), XR_TYPE_SWAPCHAIN_IMAGE_DIRTY_RECTS_EXTX);
+
+    // The copy and the runtime's xrReleaseSwapchainImage happen on the copy
+    // queue's thread; a runtime error there is returned by this swapchain's
+    // next xrAcquireSwapchainImage or xrWaitSwapchainImage
+    // Not waited for here even with gSynchronizeEveryProc; the next acquire,
+    // wait, or Main xrEndFrame that depends on it waits instead
+    mainAsOverlaySwapchain->copyQueue->Enqueue(swapchainInfo.get(), which, handedOff, std::move(region), releaseInfoCopy);
+
+    return XR_SUCCESS;
+}
+
+XrResult OverlaysLayerReleaseSwapchainImageOverlay(XrInstance instance, XrSwapchain swapchain, const XrSwapchainImageReleaseInfo* releaseInfo)
+{
+    OverlaysLayerXrSwapchainHandleInfo::Ptr swapchainInfo = OverlaysLayerGetHandleInfoFromXrSwapchain(swapchain);
+
+    if(!swapchainInfo->overlaySwapchain->waited) {
+        return XR_ERROR_CALL_ORDER_INVALID;
+    }
+
+    auto& overlaySwapchain = swapchainInfo->overlaySwapchain;
+
+    uint32_t beingReleased = overlaySwapchain->acquired.Front();
+
+    overlaySwapchain->acquired.Pop();
+
+    if(!overlaySwapchain->images->Release(beingReleased, SWAPCHAIN_IMAGE_OWNER_MAIN)) {
         return XR_ERROR_RUNTIME_FAILURE;
     }
 
+    HANDLE sourceImage = overlaySwapchain->images->GetSharedHandle(beingReleased);
+    HANDLE sourceSync = overlaySwapchain->images->GetSharedSyncHandle(beingReleased);
+
+    auto releaseInfoCopy = GetSharedCopyHandlesRestored(instance, "xrReleaseSwapchainImage", releaseInfo);
+    XrResult result = RPCCallReleaseSwapchainImage(instance, swapchainInfo->actualHandle, releaseInfoCopy.get(), sourceImage, sourceSync);
+
+    if(!XR_SUCCEEDED(result)) {
+        DebugBreak(); // XXX
+        return result;
+    }
+
+    swapchainInfo->overlaySwapchain->waited = false;
+
     return result;
 }
 
-XrResult OverlaysLayerReleaseSwapchainImageMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSwapchain swapchain, const XrSwapchainImageReleaseInfo* releaseInfo, HANDLE sourceImage)
+XrResult OverlaysLayerExportSwapchainImagesMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSwapchain swapchain, uint32_t handleCapacityInput, uint32_t* handleCountOutput, uint64_t* handles)
 {
     auto synchronizeEveryProcLock = gSynchronizeEveryProc ? std::unique_lock<std::recursive_mutex>(gSynchronizeEveryProcMutex) : std::unique_lock<std::recursive_mutex>();
 
-    OverlaysLayerXrSwapchainHandleInfo::Ptr swapchainInfo = OverlaysLayerGetHandleInfoFromXrSwapchain(swapchain);
+    if(!gZeroCopySwapchains) {
+        return XR_ERROR_FEATURE_UNSUPPORTED;
+    }
 
+    OverlaysLayerXrSwapchainHandleInfo::Ptr swapchainInfo = OverlaysLayerGetHandleInfoFromXrSwapchain(swapchain);
     auto& mainAsOverlaySwapchain = swapchainInfo->mainAsOverlaySwapchain;
 
-    ID3D11Device* d3d11Device;
-    {
-        OverlaysLayerXrSessionHandleInfo::Ptr sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(swapchainInfo->parentHandle);
-        d3d11Device = sessionInfo->d3d11Device;
+    if(!mainAsOverlaySwapchain->acquired.Empty()) {
+        return XR_ERROR_CALL_ORDER_INVALID;
     }
 
-    ID3D11Texture2D *sharedTexture = mainAsOverlaySwapchain->getSharedTexture(d3d11Device, sourceImage);
-
-    {
-        IDXGIKeyedMutex* keyedMutex;
-        HRESULT result;
-        result = sharedTexture->QueryInterface( __uuidof(IDXGIKeyedMutex), (LPVOID*)&keyedMutex);
-        if(result != S_OK) {
-            LogWindowsError(result, "xrReleaseSwapchainImage", "QueryInterface", __FILE__, __LINE__);
-            return XR_ERROR_RUNTIME_FAILURE;
-        }
-        result = keyedMutex->AcquireSync(SwapchainCachedData::KEYED_MUTEX_MAIN, INFINITE); // XXX INFINITE timeout
-        keyedMutex->Release();
-        if(result != S_OK) {
-            LogWindowsError(result, "xrReleaseSwapchainImage", "AcquireSync", __FILE__, __LINE__);
-            return XR_ERROR_RUNTIME_FAILURE;
+    // Main's GPU waits on the overlay's fence before each runtime release
+    OverlaysLayerXrSessionHandleInfo::Ptr sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(swapchainInfo->parentHandle);
+    auto exportedImages = std::make_shared<ExportedMainSwapchainImages>(sessionInfo->d3d11Device, (uint32_t)mainAsOverlaySwapchain->imageState.size());
+    if(!exportedImages->d3d11Device5 || !exportedImages->immediateContext4) {
+        return XR_ERROR_FEATURE_UNSUPPORTED;
+    }
+
+    std::vector<HANDLE> exported;
+    if(!mainAsOverlaySwapchain->images->ExportRuntimeImages(connection->conn.otherProcessHandle, exported)) {
+        // Overlay keeps its own images and Main copies them
+        return XR_ERROR_FEATURE_UNSUPPORTED;
+    }
+
+    *handleCountOutput = (uint32_t)exported.size();
+    if(handleCapacityInput < exported.size()) {
+        for(HANDLE h : exported) {
+            DuplicateHandle(connection->conn.otherProcessHandle, h, NULL, NULL, 0, FALSE, DUPLICATE_CLOSE_SOURCE);
         }
+        return XR_ERROR_SIZE_INSUFFICIENT;
+    }
+    for(size_t i = 0; i < exported.size(); i++) {
+        handles[i] = reinterpret_cast<uint64_t>(exported[i]);
     }
 
-    mainAsOverlaySwapchain->remoteImagesAcquired.insert(sourceImage);
-    int which = mainAsOverlaySwapchain->acquired[0];
-    mainAsOverlaySwapchain->acquired.erase(mainAsOverlaySwapchain->acquired.begin());
+    mainAsOverlaySwapchain->images = exportedImages;
 
-    ID3D11Device* d3dDevice;
-    sharedTexture->GetDevice(&d3dDevice);
-    ID3D11DeviceContext* d3dContext;
-    d3dDevice->GetImmediateContext(&d3dContext);
-    d3dContext->CopyResource(mainAsOverlaySwapchain->swapchainImages[which], sharedTexture);
+    return XR_SUCCESS;
+}
 
-    auto releaseInfoCopy = GetSharedCopyHandlesRestored(swapchainInfo->parentInstance, "xrReleaseSwapchainImage", releaseInfo);
+// Main xrEndFrames whose downchain xrEndFrame has returned; only Main's frame thread writes it
+std::atomic<uint64_t> gMainFramesCompleted = 0;
 
-	XrResult result = XR_SUCCESS;
-    {
-        std::unique_lock<std::recursive_mutex> HapticQuirkLock(HapticQuirkMutex);
-        result = swapchainInfo->downchain->ReleaseSwapchainImage(swapchainInfo->actualHandle, releaseInfoCopy.get());
-        if(result != XR_SUCCESS) DebugBreak(); // XXX
+bool OverlaysLayerSwapchainInFlight(const OverlaysLayerXrSwapchainHandleInfo* info)
+{
+    if((info->layerSetsReferencing > 0) || (info->lastSubmittedFrame > gMainFramesCompleted)) {
+        return true;
     }
-
-    return result;
+    // Still waiting on its own Main session's copy queue for its runtime xrReleaseSwapchainImage;
+    // a stopped queue reports everything done
+    const auto& cached = info->mainAsOverlaySwapchain;
+    return cached && !cached->copyQueue->IsDone(cached->lastCopyQueued);
 }
 
-XrResult OverlaysLayerReleaseSwapchainImageOverlay(XrInstance instance, XrSwapchain swapchain, const XrSwapchainImageReleaseInfo* releaseInfo)
+void MainAsOverlaySessionContext::LayerSet::clear()
 {
-    OverlaysLayerXrSwapchainHandleInfo::Ptr swapchainInfo = OverlaysLayerGetHandleInfoFromXrSwapchain(swapchain);
-
-    if(!swapchainInfo->overlaySwapchain->waited) {
-        return XR_ERROR_CALL_ORDER_INVALID;
+    for(auto swapchainInfo: swapchains) {
+        swapchainInfo->layerSetsReferencing--;
     }
+    layers.clear();
+    swapchains.clear();
+    spaces.clear();
+    lateLatches.clear();
+}
 
-    auto& overlaySwapchain = swapchainInfo->overlaySwapchain;
+// Caller holds an epoch guard, so a swapchain being destroyed concurrently is
+// either not found or counted before the reclaimer can check it
+static void AddSwapchainReference(XrSwapchain swapchain, std::vector<OverlaysLayerXrSwapchainHandleInfo*>& swapchains)
+{
+    OverlaysLayerXrSwapchainHandleInfo* swapchainInfo = OverlaysLayerBorrowHandleInfoFromXrSwapchain(swapchain);
+    swapchainInfo->layerSetsReferencing++;
+    swapchains.push_back(swapchainInfo);
+}
 
-    uint32_t beingReleased = overlaySwapchain->acquired[0];
+void AddSwapchainsFromLayers(OverlaysLayerXrSessionHandleInfo* sessionInfo, const XrCompositionLayerBaseHeader* p, std::vector<OverlaysLayerXrSwapchainHandleInfo*>& swapchains)
+{
+    switch(p->type) {
+        case XR_TYPE_COMPOSITION_LAYER_QUAD: {
+            auto p2 = reinterpret_cast<const XrCompositionLayerQuad*>(p);
+            AddSwapchainReference(p2->subImage.swapchain, swapchains);
+            break;
+        }
+        case XR_TYPE_COMPOSITION_LAYER_PROJECTION: {
+            auto p2 = reinterpret_cast<const XrCompositionLayerProjection*>(p);
+            for(uint32_t j = 0; j < p2->viewCount; j++) {
+                AddSwapchainReference(p2->views[j].subImage.swapchain, swapchains);
+            }
+            break;
+        }
+        case XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR: {
+            auto p2 = reinterpret_cast<const XrCompositionLayerDepthInfoKHR*>(p);
+            AddSwapchainReference(p2->subImage.swapchain, swapchains);
+            break;
+        }
+        default: {
+            char structureTypeName[XR_MAX_STRUCTURE_NAME_SIZE];
+            auto sessLock = sessionInfo->GetLock();
+            XrResult r = sessionInfo->downchain->StructureTypeToString(sessionInfo->parentInstance, p->type, structureTypeName);
+            if(r != XR_SUCCESS) {
+                sprintf(structureTypeName, "(type %08X)", p->type);
+            }
 
-    overlaySwapchain->acquired.erase(overlaySwapchain->acquired.begin());
+            OverlaysLayerLogMessage(sessionInfo->parentInstance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT, "xrEndFrame",
+                OverlaysLayerNoObjectInfo, fmt("a compositiion layer was provided of a type (%s) which the Overlay API Layer does not know how to check; will not be added to swapchains protected while submitted.  A crash may result.", structureTypeName).c_str());
+            break;
+        }
+    }
+}
 
-    IDXGIKeyedMutex* keyedMutex;
-    HRESULT hresult = overlaySwapchain->swapchainTextures[beingReleased]->QueryInterface( __uuidof(IDXGIKeyedMutex), (LPVOID*)&keyedMutex);
-    if(hresult != S_OK) {
-        LogWindowsError(hresult, "xrReleaseSwapchainImage", "QueryInterface", __FILE__, __LINE__);
-        return XR_ERROR_RUNTIME_FAILURE;
+// If the overlay chained XrCompositionLayerLateLatchEXTX to this layer, unlink
+// it from the restored copy and record it so Main can re-pose the layer.
+void AddLateLatchFromLayer(OverlaysLayerXrSessionHandleInfo* sessionInfo, const XrCompositionLayerBaseHeader* layer, const std::shared_ptr<const XrCompositionLayerBaseHeader>& copy, MainAsOverlaySessionContext::LayerSet& layers)
+{
+    // We allocated the copy ourselves, so just cast ugly
+    auto prev = reinterpret_cast<XrBaseInStructure*>(const_cast<XrCompositionLayerBaseHeader*>(copy.get()));
+    while(prev->next && (prev->next->type != XR_TYPE_COMPOSITION_LAYER_LATE_LATCH_EXTX)) {
+        prev = const_cast<XrBaseInStructure*>(prev->next);
     }
-    hresult = keyedMutex->ReleaseSync(SwapchainCachedData::KEYED_MUTEX_MAIN);
-    keyedMutex->Release();
-    if(hresult != S_OK) {
-        LogWindowsError(hresult, "xrReleaseSwapchainImage", "ReleaseSync", __FILE__, __LINE__);
-        return XR_ERROR_RUNTIME_FAILURE;
+    if(!prev->next) {
+        return;
     }
 
-    HANDLE sourceImage = overlaySwapchain->swapchainHandles[beingReleased];
+    auto latch = reinterpret_cast<XrCompositionLayerLateLatchEXTX*>(const_cast<XrBaseInStructure*>(prev->next));
+    prev->next = reinterpret_cast<const XrBaseInStructure*>(latch->next);
+    latch->next = nullptr;
+    std::shared_ptr<const XrCompositionLayerLateLatchEXTX> latchPtr(latch, [instance=sessionInfo->parentInstance](const XrCompositionLayerLateLatchEXTX* p){ FreeXrStructChainWithFree(instance, p); });
 
-    auto releaseInfoCopy = GetSharedCopyHandlesRestored(instance, "xrReleaseSwapchainImage", releaseInfo);
-    XrResult result = RPCCallReleaseSwapchainImage(instance, swapchainInfo->actualHandle, releaseInfoCopy.get(), sourceImage);
+    if(copy->type != XR_TYPE_COMPOSITION_LAYER_QUAD) {
+        OverlaysLayerLogMessage(sessionInfo->parentInstance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT, "xrEndFrame",
+            OverlaysLayerNoObjectInfo, "XrCompositionLayerLateLatchEXTX is only supported on XrCompositionLayerQuad; ignored.");
+        return;
+    }
 
-    if(!XR_SUCCEEDED(result)) {
-        DebugBreak(); // XXX
-        return result;
+    // The overlay's original still has the local handle; keep that space alive with the layer
+    for(auto p = reinterpret_cast<const XrBaseInStructure*>(layer->next); p; p = p->next) {
+        if(p->type == XR_TYPE_COMPOSITION_LAYER_LATE_LATCH_EXTX) {
+            layers.spaces.insert(OverlaysLayerGetHandleInfoFromXrSpace(reinterpret_cast<const XrCompositionLayerLateLatchEXTX*>(p)->space));
+            break;
+        }
     }
 
-    swapchainInfo->overlaySwapchain->waited = false;
+    auto quad = reinterpret_cast<XrCompositionLayerQuad*>(const_cast<XrCompositionLayerBaseHeader*>(copy.get()));
+    layers.lateLatches.push_back({quad, latchPtr});
+}
 
+// Pose "b", expressed in a space whose pose is "a", composed into a's space
+static XrPosef ComposePoses(const XrPosef& a, const XrPosef& b)
+{
+    const XrQuaternionf& q = a.orientation;
+    const XrQuaternionf& r = b.orientation;
+    const XrVector3f& v = b.position;
+
+    XrPosef result;
+    result.orientation = {
+        q.w * r.x + q.x * r.w + q.y * r.z - q.z * r.y,
+        q.w * r.y - q.x * r.z + q.y * r.w + q.z * r.x,
+        q.w * r.z + q.x * r.y - q.y * r.x + q.z * r.w,
+        q.w * r.w - q.x * r.x - q.y * r.y - q.z * r.z,
+    };
+
+    // rotate v by q: v + 2w(u x v) + 2u x (u x v)
+    XrVector3f t = { 2 * (q.y * v.z - q.z * v.y), 2 * (q.z * v.x - q.x * v.z), 2 * (q.x * v.y - q.y * v.x) };
+    result.position = {
+        a.position.x + v.x + q.w * t.x + (q.y * t.z - q.z * t.y),
+        a.position.y + v.y + q.w * t.y + (q.z * t.x - q.x * t.z),
+        a.position.z + v.z + q.w * t.z + (q.x * t.y - q.y * t.x),
+    };
     return result;
 }
 
 XrResult OverlaysLayerEndFrameMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSession session, const XrFrameEndInfo* frameEndInfo)
 {
-    std::unique_lock<std::recursive_mutex> EndFrameLock(EndFrameMutex);
-    OverlaysLayerXrSessionHandleInfo::Ptr sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(session);
+    OverlaysLayerEpochGuard epochGuard;
+    OverlaysLayerXrSessionHandleInfo* sessionInfo = OverlaysLayerBorrowHandleInfoFromXrSession(session);
 
     XrResult result = XR_SUCCESS;
 
-    // TODO: validate blend mode matches main session
-    //
+    // Only this RPC thread writes overlayLayers, so the write buffer needs no lock;
+    // Main picks the set up on its next xrEndFrame.
+    MainAsOverlaySessionContext::Ptr ctx;
     {
-        auto lock = connection->ctx->GetLock();
-        connection->ctx->overlayLayers.clear();
+        auto l = connection->GetLock();
+        ctx = connection->ctx;
+    }
+    FrameTimingScope frameTiming(&ctx->frameTimings, XR_FRAME_TIMING_PHASE_END_FRAME_EXTX);
+
+    auto& layers = ctx->overlayLayers.GetWriteBuffer();
+    layers.clear();
+
+    for(auto p = reinterpret_cast<const XrBaseInStructure*>(frameEndInfo->next); p; p = p->next) {
+        if(p->type == XR_TYPE_OVERLAY_UPDATE_RATE_INFO_EXTX) {
+            ctx->SetFrameInterval(reinterpret_cast<const XrOverlayUpdateRateInfoEXTX*>(p)->frameInterval);
+        }
     }
 
+    // TODO: validate blend mode matches main session
+    //
+
     if(frameEndInfo->layerCount > MainAsOverlaySessionContext::maxOverlayCompositionLayers) {
 
         result = XR_ERROR_LAYER_LIMIT_EXCEEDED;
 
     } else {
 
-        for(uint32_t i = 0; (result == XR_SUCCESS) && (i < frameEndInfo->layerCount); i++) {
+        // Restore actual handles now, on this thread, so Main's xrEndFrame doesn't copy or translate these again.
+        try {
+            for(uint32_t i = 0; (result == XR_SUCCESS) && (i < frameEndInfo->layerCount); i++) {
 
-            std::shared_ptr<const XrCompositionLayerBaseHeader> copy(reinterpret_cast<const XrCompositionLayerBaseHeader*>(CopyXrStructChainWithMalloc(sessionInfo->parentInstance, frameEndInfo->layers[i])), [instance=sessionInfo->parentInstance](const XrCompositionLayerBaseHeader*p){ FreeXrStructChainWithFree(instance, p);});
+                auto copy = GetSharedCopyHandlesRestored(sessionInfo->parentInstance, "xrEndFrame", frameEndInfo->layers[i]);
 
-            if(!copy) {
+                if(!copy) {
 
-                auto lock = connection->ctx->GetLock();
-                connection->ctx->overlayLayers.clear();
-                result = XR_ERROR_OUT_OF_MEMORY;
+                    result = XR_ERROR_OUT_OF_MEMORY;
 
-            } else {
+                } else {
 
-                auto lock = connection->ctx->GetLock();
-                connection->ctx->overlayLayers.push_back(copy);
+                    AddSwapchainsFromLayers(sessionInfo, frameEndInfo->layers[i], layers.swapchains);
+                    layers.spaces.insert(OverlaysLayerGetHandleInfoFromXrSpace(frameEndInfo->layers[i]->space));
+                    AddLateLatchFromLayer(sessionInfo, frameEndInfo->layers[i], copy, layers);
+                    layers.layers.push_back(copy);
 
+                }
             }
+        } catch (const OverlaysLayerXrException& exc) {
+            result = exc.result();
+        }
+    }
+
+    // Shown swapchains the overlay didn't release since its last xrEndFrame
+    // reuse the runtime image already holding their contents
+    bool reusedAllImages = !layers.swapchains.empty();
+    for(auto swapchainInfo: layers.swapchains) {
+        auto& mainAsOverlaySwapchain = swapchainInfo->mainAsOverlaySwapchain;
+        if(!mainAsOverlaySwapchain) {
+            continue;
         }
+        if(mainAsOverlaySwapchain->releaseCount == 0) {
+            // The runtime would fail Main's whole xrEndFrame over it
+            result = XR_ERROR_LAYER_INVALID;
+        } else if(mainAsOverlaySwapchain->releaseCount != mainAsOverlaySwapchain->releaseCountAtSubmit) {
+            reusedAllImages = false;
+        }
+    }
+    for(auto swapchainInfo: layers.swapchains) {
+        if(swapchainInfo->mainAsOverlaySwapchain) {
+            swapchainInfo->mainAsOverlaySwapchain->releaseCountAtSubmit = swapchainInfo->mainAsOverlaySwapchain->releaseCount;
+        }
+    }
+
+    if(result != XR_SUCCESS) {
+        layers.clear();
+    } else if(reusedAllImages) {
+        ctx->staticFrames++;
     }
+    layers.submitted = std::chrono::steady_clock::now();
+    ctx->overlayLayers.Publish();
+    ctx->submittedFrames++;
 
     return result;
 }
 
 XrResult OverlaysLayerEndFrameOverlay(XrInstance instance, XrSession session, const XrFrameEndInfo* frameEndInfo)
 {
-    OverlaysLayerXrSessionHandleInfo::Ptr sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(session);
+    OverlaysLayerEpochGuard epochGuard;
+    OverlaysLayerXrSessionHandleInfo* sessionInfo = OverlaysLayerBorrowHandleInfoFromXrSession(session);
 
     auto frameEndInfoCopy = GetSharedCopyHandlesRestored(instance, "xrEndFrame", frameEndInfo);
 
@@ -3303,40 +5104,135 @@ XrResult OverlaysLayerEndFrameOverlay(XrInstance instance, XrSession session, co
     return result;
 }
 
-void AddSwapchainsFromLayers(OverlaysLayerXrSessionHandleInfo::Ptr sessionInfo, std::shared_ptr<const XrCompositionLayerBaseHeader> p, std::set<std::shared_ptr<OverlaysLayerXrSwapchainHandleInfo>> swapchains)
+// Updates the overlay's staleness accounting for this Main frame and returns
+// the alpha its layers should be submitted with; 0 means withhold them.
+static float ApplyStaleLayerPolicy(MainSessionContext* mainSession, MainAsOverlaySessionContext* ctx, const MainAsOverlaySessionContext::LayerSet& layers, bool fresh)
 {
-    switch(p->type) {
-        case XR_TYPE_COMPOSITION_LAYER_QUAD: {
-            auto p2 = reinterpret_cast<const XrCompositionLayerQuad*>(p.get());
-            OverlaysLayerXrSwapchainHandleInfo::Ptr swapchainInfo = OverlaysLayerGetHandleInfoFromXrSwapchain(p2->subImage.swapchain);
-            swapchains.insert(swapchainInfo);
-            break;
+    if(fresh) {
+        ctx->framesSinceSubmission = 0;
+        XrDuration latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - layers.submitted).count();
+        ctx->lastSubmitLatency = latency;
+        if(latency > ctx->maxSubmitLatency) {
+            ctx->maxSubmitLatency = latency;
         }
-        case XR_TYPE_COMPOSITION_LAYER_PROJECTION: {
-            auto p2 = reinterpret_cast<const XrCompositionLayerProjection*>(p.get());
-            for(uint32_t j = 0; j < p2->viewCount; j++) {
-                OverlaysLayerXrSwapchainHandleInfo::Ptr swapchainInfo = OverlaysLayerGetHandleInfoFromXrSwapchain(p2->views[j].subImage.swapchain);
-                swapchains.insert(swapchainInfo);
+        return 1.0f;
+    }
+
+    if(layers.layers.empty()) {
+        return 0.0f;
+    }
+
+    ctx->framesSinceSubmission++;
+
+    // A decimated overlay isn't expected to submit in between its updates
+    if(ctx->framesSinceSubmission < ctx->frameInterval) {
+        return 1.0f;
+    }
+    uint32_t staleFor = ctx->framesSinceSubmission - (ctx->frameInterval - 1);
+    ctx->staleFrames++;
+
+    if(staleFor <= ctx->staleFrameLimit) {
+        return 1.0f;
+    }
+
+    float alpha = 1.0f;
+    switch(ctx->stalePolicy) {
+        case XR_OVERLAY_STALE_LAYER_POLICY_DROP_EXTX:
+            alpha = 0.0f;
+            break;
+        case XR_OVERLAY_STALE_LAYER_POLICY_FADE_EXTX: {
+            // Without color scale and bias there's no way to fade, so just drop
+            uint32_t fading = staleFor - ctx->staleFrameLimit;
+            if(mainSession->colorScaleBiasEnabled && (fading < ctx->staleFrameLimit)) {
+                alpha = 1.0f - float(fading) / ctx->staleFrameLimit;
+            } else {
+                alpha = 0.0f;
             }
             break;
         }
-        case XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR: {
-            auto p2 = reinterpret_cast<const XrCompositionLayerDepthInfoKHR*>(p.get());
-            OverlaysLayerXrSwapchainHandleInfo::Ptr swapchainInfo = OverlaysLayerGetHandleInfoFromXrSwapchain(p2->subImage.swapchain);
-            swapchains.insert(swapchainInfo);
+        default:
             break;
+    }
+
+    if(alpha <= 0.0f) {
+        ctx->droppedFrames++;
+    }
+    return alpha;
+}
+
+// Copy of a layer into the arena with its color scaled by alpha.
+// Layer types we can't copy are returned unfaded.
+static const XrCompositionLayerBaseHeader* CopyLayerWithAlphaScale(XrInstance instance, ScratchArena& arena, const XrCompositionLayerBaseHeader* layer, float alpha)
+{
+    size_t size;
+    switch(layer->type) {
+        case XR_TYPE_COMPOSITION_LAYER_QUAD: size = sizeof(XrCompositionLayerQuad); break;
+        case XR_TYPE_COMPOSITION_LAYER_PROJECTION: size = sizeof(XrCompositionLayerProjection); break;
+        default: return layer;
+    }
+
+    // The overlay's own scale and bias are faded in a copy of the whole chain; the runtime may reject a second one
+    if(FindStructInChain<XrCompositionLayerColorScaleBiasKHR>(layer->next, XR_TYPE_COMPOSITION_LAYER_COLOR_SCALE_BIAS_KHR)) {
+        XrBaseInStructure* copy = CopyXrStructChain(instance, reinterpret_cast<const XrBaseInStructure*>(layer), COPY_EVERYTHING,
+            [&arena](size_t size){ return arena.allocate(size); }, [](void*){});
+        if(!copy) {
+            return layer;
         }
-        default: {
-            char structureTypeName[XR_MAX_STRUCTURE_NAME_SIZE];
-            auto sessLock = sessionInfo->GetLock();
-            XrResult r = sessionInfo->downchain->StructureTypeToString(sessionInfo->parentInstance, p->type, structureTypeName);
-            if(r != XR_SUCCESS) {
-                sprintf(structureTypeName, "(type %08X)", p->type);
-            }
+        auto scaleBias = const_cast<XrCompositionLayerColorScaleBiasKHR*>(FindStructInChain<XrCompositionLayerColorScaleBiasKHR>(copy->next, XR_TYPE_COMPOSITION_LAYER_COLOR_SCALE_BIAS_KHR));
+        // premultiplied, so the bias fades too
+        scaleBias->colorScale = { scaleBias->colorScale.r * alpha, scaleBias->colorScale.g * alpha, scaleBias->colorScale.b * alpha, scaleBias->colorScale.a * alpha };
+        scaleBias->colorBias = { scaleBias->colorBias.r * alpha, scaleBias->colorBias.g * alpha, scaleBias->colorBias.b * alpha, scaleBias->colorBias.a * alpha };
+        return reinterpret_cast<const XrCompositionLayerBaseHeader*>(copy);
+    }
 
-            OverlaysLayerLogMessage(sessionInfo->parentInstance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT, "xrEndFrame",
-                OverlaysLayerNoObjectInfo, fmt("a compositiion layer was provided of a type (%s) which the Overlay API Layer does not know how to check; will not be added to swapchains protected while submitted.  A crash may result.", structureTypeName).c_str());
-            break;
+    auto faded = reinterpret_cast<XrCompositionLayerBaseHeader*>(arena.allocate(size));
+    memcpy(faded, layer, size);
+
+    auto scaleBias = reinterpret_cast<XrCompositionLayerColorScaleBiasKHR*>(arena.allocate(sizeof(XrCompositionLayerColorScaleBiasKHR)));
+    scaleBias->type = XR_TYPE_COMPOSITION_LAYER_COLOR_SCALE_BIAS_KHR;
+    scaleBias->next = layer->next;
+    scaleBias->colorScale = { alpha, alpha, alpha, alpha }; // premultiplied
+    scaleBias->colorBias = { 0.0f, 0.0f, 0.0f, 0.0f };
+    faded->next = scaleBias;
+
+    return faded;
+}
+
+// Leave out whole overlays, least important first, until Main's and the
+// overlays' layers fit in the runtime's maxLayerCount.
+static void ApplyLayerBudget(XrInstance instance, MainSessionContext* mainSession, const OverlaysInDepthOrder& overlays, uint32_t mainLayerCount)
+{
+    auto& order = mainSession->endFrameBudgetOrder;
+    order.clear();
+    for(const auto& overlay: overlays) {
+        if(overlay.ctx->frameLayers) {
+            order.push_back(overlay.ctx.get());
+        }
+    }
+    std::sort(order.begin(), order.end(), [](const MainAsOverlaySessionContext* a, const MainAsOverlaySessionContext* b) {
+        if(a->importance != b->importance) {
+            return a->importance > b->importance;
+        }
+        return a->sessionLayersPlacement > b->sessionLayersPlacement;
+    });
+
+    uint32_t available = (mainSession->maxLayerCount > mainLayerCount) ? (mainSession->maxLayerCount - mainLayerCount) : 0;
+    for(auto ctx: order) {
+        uint32_t count = (uint32_t)ctx->frameLayers->layers.size();
+        bool culled = count > available;
+        if(culled) {
+            ctx->frameLayers = nullptr;
+            ctx->culledFrames++;
+        } else {
+            available -= count;
+        }
+
+        // Log only changes so a persistently culled overlay doesn't log every frame
+        if(culled != ctx->culledLastFrame) {
+            OverlaysLayerLogMessage(instance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT, "xrEndFrame",
+                OverlaysLayerNoObjectInfo, fmt("overlay with placement %u and importance %u %s: needs %u layers, %u left of maxLayerCount %u",
+                ctx->sessionLayersPlacement, ctx->importance, culled ? "culled" : "restored", count, available + (culled ? 0 : count), mainSession->maxLayerCount).c_str());
+            ctx->culledLastFrame = culled;
         }
     }
 }
@@ -3345,71 +5241,118 @@ XrResult OverlaysLayerEndFrameMain(XrInstance parentInstance, XrSession session,
 {
     auto synchronizeEveryProcLock = gSynchronizeEveryProc ? std::unique_lock<std::recursive_mutex>(gSynchronizeEveryProcMutex) : std::unique_lock<std::recursive_mutex>();
 
-    std::unique_lock<std::recursive_mutex> EndFrameLock(EndFrameMutex);
-    OverlaysLayerXrSessionHandleInfo::Ptr sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(session);
+    OverlaysLayerEpochGuard epochGuard;
+    OverlaysLayerXrSessionHandleInfo* sessionInfo = OverlaysLayerBorrowHandleInfoFromXrSession(session);
 
-    // combine overlay and main layers
+    auto mainSession = gMainSessionContext;
 
-    std::vector<const XrCompositionLayerBaseHeader*> layersMerged;
+    // Last frame's copies were consumed when its downchain EndFrame returned
+    ScratchArena& arena = mainSession->endFrameArena;
+    std::vector<const XrCompositionLayerBaseHeader*>& layersMerged = mainSession->endFrameLayers;
+    std::vector<const OverlayLateLatchedLayer*>& lateLatches = mainSession->endFrameLateLatches;
+    arena.reset();
+    layersMerged.clear();
+    lateLatches.clear();
+
+    auto copyHandlesRestoredIntoArena = [parentInstance, &arena](const void* xrstruct) {
+        XrBaseInStructure* copy = CopyXrStructChain(parentInstance, reinterpret_cast<const XrBaseInStructure*>(xrstruct), COPY_EVERYTHING,
+            [&arena](size_t size){ return arena.allocate(size); }, [](void*){});
+        if(copy && !RestoreActualHandles(parentInstance, copy)) {
+            OverlaysLayerLogMessage(parentInstance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrEndFrame",
+                OverlaysLayerNoObjectInfo, "FATAL: handles could not be restored.\n");
+            throw OverlaysLayerXrException(XR_ERROR_HANDLE_INVALID);
+        }
+        return copy;
+    };
+
+    // combine overlay and main layers
 
     for(uint32_t i = 0; i < frameEndInfo->layerCount; i++) {
-        layersMerged.push_back(frameEndInfo->layers[i]);
+        layersMerged.push_back(reinterpret_cast<const XrCompositionLayerBaseHeader*>(copyHandlesRestoredIntoArena(frameEndInfo->layers[i])));
     }
 
-    std::set<std::shared_ptr<OverlaysLayerXrSwapchainHandleInfo>> swapchainsInFlight;
+    XrFrameEndInfo frameEndInfoMerged { XR_TYPE_FRAME_END_INFO };
+    frameEndInfoMerged.next = copyHandlesRestoredIntoArena(frameEndInfo->next);
+    frameEndInfoMerged.displayTime = frameEndInfo->displayTime;
+    frameEndInfoMerged.environmentBlendMode = frameEndInfo->environmentBlendMode;
 
-    {
-        std::unique_lock<std::recursive_mutex> connectionLock(gConnectionsToOverlayByProcessIdMutex);
-        if(!gConnectionsToOverlayInDepthOrder.empty()) {
-            for(auto& overlayconn: gConnectionsToOverlayInDepthOrder) {
-                connectionLock.unlock();
-                auto lock = overlayconn->GetLock();
-                if(overlayconn->ctx) {
-                    auto lock2 = overlayconn->ctx->GetLock();
-                    for(uint32_t i = 0; i < overlayconn->ctx->overlayLayers.size(); i++) {
-                        AddSwapchainsFromLayers(sessionInfo, overlayconn->ctx->overlayLayers[i], swapchainsInFlight);
-                        layersMerged.push_back(overlayconn->ctx->overlayLayers[i].get());
-                    }
-                }
-                connectionLock.lock();
+    // Snapshot holds each overlay's ctx, so no connection locks are needed here
+    auto overlays = GetOverlaysInDepthOrder();
+    for(const auto& overlay: *overlays) {
+        // Latest complete submission, already in actual handles; doesn't wait on an overlay mid-xrEndFrame
+        bool fresh;
+        const auto& overlayLayers = overlay.ctx->overlayLayers.AcquireLatest(&fresh);
+        overlay.ctx->frameAlpha = ApplyStaleLayerPolicy(mainSession.get(), overlay.ctx.get(), overlayLayers, fresh);
+        overlay.ctx->frameLayers = (overlay.ctx->frameAlpha > 0.0f) ? &overlayLayers : nullptr;
+    }
+
+    // Overlay images released before their layers were submitted must be released to the runtime too
+    mainSession->imageCopies->WaitForAll();
+
+    // A swapchain whose latest release wasn't copied shows an image Main never got
+    for(const auto& overlay: *overlays) {
+        if(!overlay.ctx->frameLayers) {
+            continue;
+        }
+        for(auto swapchainInfo: overlay.ctx->frameLayers->swapchains) {
+            if(swapchainInfo->mainAsOverlaySwapchain->latestReleaseUncopied) {
+                overlay.ctx->frameLayers = nullptr;
+                overlay.ctx->stalledFrames++;
+                break;
             }
         }
     }
-    
-    {
-        auto mainSession = gMainSessionContext;
-        auto lock2 = mainSession->GetLock();
-        mainSession->swapchainsInFlight = swapchainsInFlight;
-    }
 
-    // Malloc this struct and the layer pointers array and then deep copy "next" and the layer pointers.
-    // unique_ptr will free the whole deep copy later with custom deleter.
-    std::shared_ptr<XrFrameEndInfo> frameEndInfoMerged(reinterpret_cast<XrFrameEndInfo*>(malloc(sizeof(XrFrameEndInfo))), [instance=sessionInfo->parentInstance](const XrFrameEndInfo* p){ FreeXrStructChainWithFree(instance, p);});
+    ApplyLayerBudget(parentInstance, mainSession.get(), *overlays, frameEndInfo->layerCount);
 
-    frameEndInfoMerged->type = XR_TYPE_FRAME_END_INFO;
-    frameEndInfoMerged->next = CopyXrStructChainWithMalloc(parentInstance, frameEndInfo->next);
-    frameEndInfoMerged->displayTime = frameEndInfo->displayTime;
-    frameEndInfoMerged->environmentBlendMode = frameEndInfo->environmentBlendMode;
-    frameEndInfoMerged->layerCount = (uint32_t)layersMerged.size();
+    for(const auto& overlay: *overlays) {
+        if(overlay.ctx->frameLayers) {
+            for(const auto& lateLatch: overlay.ctx->frameLayers->lateLatches) {
+                lateLatches.push_back(&lateLatch);
+            }
+        }
+    }
 
-    if(frameEndInfoMerged->layerCount > 0) {
+    auto sessLock = sessionInfo->GetLock();
 
-        auto layerPointers = reinterpret_cast<XrCompositionLayerBaseHeader**>(malloc(sizeof(XrCompositionLayerBaseHeader*) * layersMerged.size()));
-        frameEndInfoMerged->layers = layerPointers;
-        for(size_t i = 0; i < layersMerged.size(); i++) {
-            layerPointers[i] = reinterpret_cast<XrCompositionLayerBaseHeader*>(CopyXrStructChainWithMalloc(parentInstance, layersMerged[i]));
+    // Re-pose late-latched overlay layers as close to submission as we can.
+    // If the space can't be located, the layer keeps the last pose it had.
+    for(auto lateLatch: lateLatches) {
+        XrSpaceLocation location { XR_TYPE_SPACE_LOCATION };
+        XrResult locateResult = sessionInfo->downchain->LocateSpace(lateLatch->latch->space, lateLatch->layer->space, frameEndInfo->displayTime, &location);
+        const XrSpaceLocationFlags valid = XR_SPACE_LOCATION_ORIENTATION_VALID_BIT | XR_SPACE_LOCATION_POSITION_VALID_BIT;
+        if(XR_SUCCEEDED(locateResult) && ((location.locationFlags & valid) == valid)) {
+            lateLatch->layer->pose = ComposePoses(location.pose, lateLatch->latch->pose);
         }
+    }
 
-    } else {
-
-        frameEndInfoMerged->layers = nullptr;
+    // Swapchains stamped with this frame stay alive at least until its downchain xrEndFrame returns
+    uint64_t frameNumber = gMainFramesCompleted + 1;
 
+    for(const auto& overlay: *overlays) {
+        if(!overlay.ctx->frameLayers) {
+            continue;
+        }
+        for(auto swapchainInfo: overlay.ctx->frameLayers->swapchains) {
+            swapchainInfo->lastSubmittedFrame = frameNumber;
+        }
+        for(const auto& layer: overlay.ctx->frameLayers->layers) {
+            if(overlay.ctx->frameAlpha < 1.0f) {
+                layersMerged.push_back(CopyLayerWithAlphaScale(parentInstance, arena, layer.get(), overlay.ctx->frameAlpha));
+            } else {
+                layersMerged.push_back(layer.get());
+            }
+        }
     }
 
-    auto frameEndInfoMergedCopy = GetSharedCopyHandlesRestored(sessionInfo->parentInstance, "xrEndFrame", frameEndInfoMerged.get());
+    frameEndInfoMerged.layerCount = (uint32_t)layersMerged.size();
+    frameEndInfoMerged.layers = layersMerged.empty() ? nullptr : layersMerged.data();
 
-    auto sessLock = sessionInfo->GetLock();
-    XrResult result = sessionInfo->downchain->EndFrame(sessionInfo->actualHandle, frameEndInfoMergedCopy.get());
+    FrameTimingScope::DownchainBegin();
+    XrResult result = sessionInfo->downchain->EndFrame(sessionInfo->actualHandle, &frameEndInfoMerged);
+    FrameTimingScope::DownchainEnd();
+
+    gMainFramesCompleted = frameNumber;
 
     return result;
 }
@@ -3419,9 +5362,15 @@ XrResult OverlaysLayerEndFrame(XrSession session, const XrFrameEndInfo* frameEnd
     try { 
         auto synchronizeEveryProcLock = gSynchronizeEveryProc ? std::unique_lock<std::recursive_mutex>(gSynchronizeEveryProcMutex) : std::unique_lock<std::recursive_mutex>();
 
-        auto sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(session);
+        OverlaysLayerEpochGuard epochGuard;
+        auto sessionInfo = OverlaysLayerBorrowHandleInfoFromXrSession(session);
         
         bool isProxied = sessionInfo->isProxied;
+
+        // Overlays' frame calls are timed as they arrive in Main instead
+        auto mainSessionForTiming = isProxied ? nullptr : gMainSessionContext;
+        FrameTimingScope frameTiming(mainSessionForTiming ? &mainSessionForTiming->frameTimings : nullptr, XR_FRAME_TIMING_PHASE_END_FRAME_EXTX);
+
         XrResult result;
         if(isProxied) {
             result = OverlaysLayerEndFrameOverlay(sessionInfo->parentInstance, session, frameEndInfo);
@@ -3442,6 +5391,159 @@ XrResult OverlaysLayerEndFrame(XrSession session, const XrFrameEndInfo* frameEnd
 }
 
 
+XrResult XRAPI_CALL OverlaysLayerEnumerateOverlayStatsEXTX(XrInstance instance, uint32_t statsCapacityInput, uint32_t* statsCountOutput, XrOverlayStatsEXTX* stats)
+{
+    try {
+        OverlaysLayerGetHandleInfoFromXrInstance(instance); // throws if not a valid instance
+
+        // Only Main's instance has overlays
+        std::shared_ptr<const OverlaysInDepthOrder> overlays = std::make_shared<const OverlaysInDepthOrder>();
+        if(instance == gMainSessionInstance) {
+            overlays = GetOverlaysInDepthOrder();
+        }
+
+        *statsCountOutput = (uint32_t)overlays->size();
+        if(statsCapacityInput == 0) {
+            return XR_SUCCESS;
+        }
+        if(statsCapacityInput < overlays->size()) {
+            return XR_ERROR_SIZE_INSUFFICIENT;
+        }
+
+        for(size_t i = 0; i < overlays->size(); i++) {
+            const auto& overlay = (*overlays)[i];
+            stats[i].overlayProcessId = overlay.connection->conn.otherProcessId;
+            stats[i].sessionLayersPlacement = overlay.sessionLayersPlacement;
+            stats[i].stalePolicy = overlay.ctx->stalePolicy;
+            stats[i].importance = overlay.ctx->importance;
+            stats[i].frameInterval = overlay.ctx->frameInterval;
+            stats[i].submittedFrames = overlay.ctx->submittedFrames;
+            stats[i].staticFrames = overlay.ctx->staticFrames;
+            stats[i].staleFrames = overlay.ctx->staleFrames;
+            stats[i].droppedFrames = overlay.ctx->droppedFrames;
+            stats[i].culledFrames = overlay.ctx->culledFrames;
+            stats[i].stalledFrames = overlay.ctx->stalledFrames;
+            stats[i].lastSubmitLatency = overlay.ctx->lastSubmitLatency;
+            stats[i].maxSubmitLatency = overlay.ctx->maxSubmitLatency;
+        }
+
+        return XR_SUCCESS;
+
+    } catch (const OverlaysLayerXrException exc) {
+
+        return exc.result();
+
+    }
+}
+
+
+// Main's own timings followed by each overlay's, in depth order; empty for any instance but Main's
+static void ReadFrameTimings(XrInstance instance, std::vector<XrFrameTimingEXTX>& timings)
+{
+    auto mainSession = gMainSessionContext;
+    if((instance != gMainSessionInstance) || !mainSession) {
+        return;
+    }
+    mainSession->frameTimings.Read(0, timings);
+    auto overlays = GetOverlaysInDepthOrder();
+    for(const auto& overlay: *overlays) {
+        overlay.ctx->frameTimings.Read(overlay.connection->conn.otherProcessId, timings);
+    }
+}
+
+static const char* FrameTimingPhaseName(XrFrameTimingPhaseEXTX phase)
+{
+    switch(phase) {
+        case XR_FRAME_TIMING_PHASE_WAIT_FRAME_EXTX: return "xrWaitFrame";
+        case XR_FRAME_TIMING_PHASE_BEGIN_FRAME_EXTX: return "xrBeginFrame";
+        case XR_FRAME_TIMING_PHASE_END_FRAME_EXTX: return "xrEndFrame";
+        default: return "unknown";
+    }
+}
+
+XrResult XRAPI_CALL OverlaysLayerEnumerateFrameTimingsEXTX(XrInstance instance, uint32_t timingCapacityInput, uint32_t* timingCountOutput, XrFrameTimingEXTX* timings)
+{
+    try {
+        OverlaysLayerGetHandleInfoFromXrInstance(instance); // throws if not a valid instance
+
+        std::vector<XrFrameTimingEXTX> recorded;
+        ReadFrameTimings(instance, recorded);
+
+        *timingCountOutput = (uint32_t)recorded.size();
+        if(timingCapacityInput == 0) {
+            return XR_SUCCESS;
+        }
+        if(timingCapacityInput < recorded.size()) {
+            return XR_ERROR_SIZE_INSUFFICIENT;
+        }
+
+        for(size_t i = 0; i < recorded.size(); i++) {
+            void* next = timings[i].next;
+            timings[i] = recorded[i];
+            timings[i].next = next;
+        }
+
+        return XR_SUCCESS;
+
+    } catch (const OverlaysLayerXrException exc) {
+
+        return exc.result();
+
+    } catch (const std::bad_alloc& e) {
+
+        OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrEnumerateFrameTimingsEXTX", OverlaysLayerNoObjectInfo, e.what());
+        return XR_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+XrResult XRAPI_CALL OverlaysLayerDumpFrameTimingsEXTX(XrInstance instance, const char* path)
+{
+    try {
+        OverlaysLayerGetHandleInfoFromXrInstance(instance); // throws if not a valid instance
+
+        std::vector<XrFrameTimingEXTX> recorded;
+        ReadFrameTimings(instance, recorded);
+
+        std::ofstream out(path);
+        if(!out) {
+            OverlaysLayerLogMessage(instance, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrDumpFrameTimingsEXTX",
+                OverlaysLayerNoObjectInfo, fmt("Could not open \"%s\" for writing", path).c_str());
+            return XR_ERROR_RUNTIME_FAILURE;
+        }
+
+        size_t pathLength = strlen(path);
+        bool json = (pathLength >= 5) && (strcmp(path + pathLength - 5, ".json") == 0);
+
+        if(json) {
+            out << "[\n";
+            for(size_t i = 0; i < recorded.size(); i++) {
+                const auto& t = recorded[i];
+                out << "  {\"process\": " << t.overlayProcessId << ", \"phase\": \"" << FrameTimingPhaseName(t.phase) << "\", \"frame\": " << t.frameTickSequence
+                    << ", \"start\": " << t.start << ", \"duration\": " << t.duration << ", \"downchain\": " << t.downchainDuration << "}"
+                    << ((i + 1 < recorded.size()) ? ",\n" : "\n");
+            }
+            out << "]\n";
+        } else {
+            out << "process,phase,frame,start,duration,downchain\n";
+            for(const auto& t: recorded) {
+                out << t.overlayProcessId << "," << FrameTimingPhaseName(t.phase) << "," << t.frameTickSequence << ","
+                    << t.start << "," << t.duration << "," << t.downchainDuration << "\n";
+            }
+        }
+
+        return out ? XR_SUCCESS : XR_ERROR_RUNTIME_FAILURE;
+
+    } catch (const OverlaysLayerXrException exc) {
+
+        return exc.result();
+
+    } catch (const std::bad_alloc& e) {
+
+        OverlaysLayerLogMessage(XR_NULL_HANDLE, XR_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "xrDumpFrameTimingsEXTX", OverlaysLayerNoObjectInfo, e.what());
+        return XR_ERROR_OUT_OF_MEMORY;
+    }
+}
+
 // We don't know until Attach whether this is proxied to main or not, so have to
 // make it now as if it will be in main
 XrResult OverlaysLayerCreateActionSet(XrInstance instance, const XrActionSetCreateInfo* createInfo, XrActionSet* actionSet)
@@ -3688,10 +5790,17 @@ XrResult OverlaysLayerCreateActionSpaceFromBinding(ConnectionToOverlay::Ptr conn
         OverlaysLayerXrSpaceHandleInfo::Ptr spaceInfo = std::make_shared<OverlaysLayerXrSpaceHandleInfo>(session, sessionInfo->parentInstance, sessionInfo->downchain);
         spaceInfo->spaceType = SPACE_ACTION;
         spaceInfo->actualHandle = actualHandle;
+        spaceInfo->localHandle = localHandle;
         spaceInfo->placeholderAction = actualActionHandle;
         // spaceInfo->isProxied; // Should never be accessed from MainAsOverlay
 
         OverlaysLayerAddHandleInfoForXrSpace(*space, spaceInfo);
+
+        {
+            // Removed with the connection's context if the overlay never destroys it
+            auto l = connection->ctx->GetLock();
+            connection->ctx->localSpaces.insert(*space);
+        }
     }
 
     return result;
@@ -4081,11 +6190,12 @@ XrResult OverlaysLayerSyncActionsAndGetStateMainAsOverlay(
     return result;
 }
 
-void ClearSessionLastSyncedActiveActionSets(OverlaysLayerXrSessionHandleInfo::Ptr sessionInfo, const XrActionsSyncInfo* syncInfo)
+void ClearSessionLastSyncedActiveActionSets(OverlaysLayerXrSessionHandleInfo* sessionInfo, const XrActionsSyncInfo* syncInfo)
 {
+    OverlaysLayerEpochGuard epochGuard;
     for(auto activeActionSet: sessionInfo->lastSyncedActiveActionSets) {
         XrActionSet actionSet = activeActionSet.actionSet;
-        auto actionSetInfo = OverlaysLayerGetHandleInfoFromXrActionSet(actionSet);
+        auto actionSetInfo = OverlaysLayerBorrowHandleInfoFromXrActionSet(actionSet);
         XrPath subactionPath = activeActionSet.subactionPath;
         for(auto actionInfo: actionSetInfo->childActions) {
             actionInfo->stateBySubactionPath.clear();
@@ -4095,9 +6205,10 @@ void ClearSessionLastSyncedActiveActionSets(OverlaysLayerXrSessionHandleInfo::Pt
 
 void ClearSyncedActiveActionSets(XrInstance parentInstance, XrSession session, const XrActionsSyncInfo* syncInfo)
 {
+    OverlaysLayerEpochGuard epochGuard;
     for(uint32_t i = 0; i < syncInfo->countActiveActionSets; i++) {
         XrActionSet actionSet = syncInfo->activeActionSets[i].actionSet;
-        auto actionSetInfo = OverlaysLayerGetHandleInfoFromXrActionSet(actionSet);
+        auto actionSetInfo = OverlaysLayerBorrowHandleInfoFromXrActionSet(actionSet);
         XrPath subactionPath = syncInfo->activeActionSets[i].subactionPath;
         for(auto actionInfo: actionSetInfo->childActions) {
             actionInfo->stateBySubactionPath.clear();
@@ -4119,17 +6230,18 @@ XrResult OverlaysLayerSyncActionsOverlay(XrInstance parentInstance, XrSession se
 {
     XrResult result = XR_SUCCESS;
 
-    auto sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(session);
-    auto instanceInfo = OverlaysLayerGetHandleInfoFromXrInstance(parentInstance);
+    OverlaysLayerEpochGuard epochGuard;
+    auto sessionInfo = OverlaysLayerBorrowHandleInfoFromXrSession(session);
+    auto instanceInfo = OverlaysLayerBorrowHandleInfoFromXrInstance(parentInstance);
 
     // Make queryable data structures for data spread across activeActionSets
-    std::set<OverlaysLayerXrActionSetHandleInfo::Ptr> actionSetInfos;
-    std::unordered_map<OverlaysLayerXrActionSetHandleInfo::Ptr, std::set<XrPath>> actionSetInfoSubactionPaths;
+    std::set<OverlaysLayerXrActionSetHandleInfo*> actionSetInfos;
+    std::unordered_map<OverlaysLayerXrActionSetHandleInfo*, std::set<XrPath>> actionSetInfoSubactionPaths;
     std::set<OverlaysLayerXrActionHandleInfo::Ptr> actionInfos;
     std::unordered_map<OverlaysLayerXrActionHandleInfo::Ptr, std::set<XrPath>> actionInfoSubactionPaths;
 
     for(uint32_t i = 0; i < syncInfo->countActiveActionSets; i++) {
-        auto actionSetInfo = OverlaysLayerGetHandleInfoFromXrActionSet(syncInfo->activeActionSets[i].actionSet);
+        auto actionSetInfo = OverlaysLayerBorrowHandleInfoFromXrActionSet(syncInfo->activeActionSets[i].actionSet);
         XrPath subactionPath = syncInfo->activeActionSets[i].subactionPath;
         actionSetInfos.insert(actionSetInfo);
         actionSetInfoSubactionPaths[actionSetInfo].insert(subactionPath);
@@ -4305,8 +6417,9 @@ XrResult OverlaysLayerSyncActionsMain(XrInstance parentInstance, XrSession sessi
 
     XrResult result = XR_SUCCESS;
 
-    auto sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(session);
-    auto instanceInfo = OverlaysLayerGetHandleInfoFromXrInstance(parentInstance);
+    OverlaysLayerEpochGuard epochGuard;
+    auto sessionInfo = OverlaysLayerBorrowHandleInfoFromXrSession(session);
+    auto instanceInfo = OverlaysLayerBorrowHandleInfoFromXrInstance(parentInstance);
 
     // Sync all the actions requested by the Main app
     {
@@ -4328,13 +6441,13 @@ XrResult OverlaysLayerSyncActionsMain(XrInstance parentInstance, XrSession sessi
     }
 
     // Make queryable data structures for data spread across activeActionSets
-    std::set<OverlaysLayerXrActionSetHandleInfo::Ptr> actionSetInfos;
-    std::unordered_map<OverlaysLayerXrActionSetHandleInfo::Ptr, std::set<XrPath>> actionSetInfoSubactionPaths;
+    std::set<OverlaysLayerXrActionSetHandleInfo*> actionSetInfos;
+    std::unordered_map<OverlaysLayerXrActionSetHandleInfo*, std::set<XrPath>> actionSetInfoSubactionPaths;
     std::set<OverlaysLayerXrActionHandleInfo::Ptr> actionInfos;
     std::unordered_map<OverlaysLayerXrActionHandleInfo::Ptr, std::set<XrPath>> actionInfoSubactionPaths;
 
     for(uint32_t i = 0; i < syncInfo->countActiveActionSets; i++) {
-        auto actionSetInfo = OverlaysLayerGetHandleInfoFromXrActionSet(syncInfo->activeActionSets[i].actionSet);
+        auto actionSetInfo = OverlaysLayerBorrowHandleInfoFromXrActionSet(syncInfo->activeActionSets[i].actionSet);
         XrPath subactionPath = syncInfo->activeActionSets[i].subactionPath;
         actionSetInfos.insert(actionSetInfo);
         actionSetInfoSubactionPaths[actionSetInfo].insert(subactionPath);
@@ -4382,7 +6495,7 @@ XrResult OverlaysLayerSyncActionsMain(XrInstance parentInstance, XrSession sessi
         uint32_t index = 0;
         for(const auto& actionGetInfo: actionsToGet) {
 
-            auto actionInfo = OverlaysLayerGetHandleInfoFromXrAction(actionGetInfo.action);
+            auto actionInfo = OverlaysLayerBorrowHandleInfoFromXrAction(actionGetInfo.action);
             auto subactionPath = actionGetInfo.subactionPath;
             actionInfo->stateBySubactionPath.insert({subactionPath, states[index]});
 
@@ -4453,7 +6566,8 @@ XrResult OverlaysLayerSyncActions(XrSession session, const XrActionsSyncInfo* sy
 {
     try {
 
-        auto sessionInfo = OverlaysLayerGetHandleInfoFromXrSession(session);
+        OverlaysLayerEpochGuard epochGuard;
+        auto sessionInfo = OverlaysLayerBorrowHandleInfoFromXrSession(session);
         
         bool isProxied = sessionInfo->isProxied;
         XrResult result;
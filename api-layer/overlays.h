@@ -2,15 +2,25 @@
 #define _OVERLAYS_H_
 
 #include <openxr/openxr.h>
+#include <openxr/openxr_platform.h>
+#include "../include/xr_extx_overlay_layer.h"
+#include "overlay_buffers.h"
+#include "session_state.h"
 #include <mutex>
 #include <new>
 #include <set>
+#include <list>
+#include <tuple>
 #include <unordered_map>
 #include <queue>
 #include <functional>
 #include <memory>
 #include <thread>
 #include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <algorithm>
 
 struct OverlaysLayerXrException
 {
@@ -71,6 +81,37 @@ inline std::string fmt(const char* fmt, ...)
     return "(fmt() failed, vsnprintf returned -1)";
 }
 
+// Epoch protection for borrowed HandleInfo pointers.  While a thread holds
+// an OverlaysLayerEpochGuard, raw pointers returned from
+// OverlaysLayerBorrowHandleInfoFrom*() stay valid even if the handle is
+// removed from its map; removed infos are retired and only freed once no
+// guard that could have observed them is still held.  Guards nest.
+struct OverlaysLayerEpochGuard
+{
+    OverlaysLayerEpochGuard();
+    ~OverlaysLayerEpochGuard();
+    OverlaysLayerEpochGuard(const OverlaysLayerEpochGuard&) = delete;
+    OverlaysLayerEpochGuard& operator=(const OverlaysLayerEpochGuard&) = delete;
+};
+
+// Hand off the last map reference of a removed object; a background thread
+// frees retired objects in batches once no guard can still observe them
+// and inUse, if provided, returns false
+void OverlaysLayerRetire(std::shared_ptr<void> retired, std::function<bool()> inUse = nullptr);
+
+// Frees what's retired and joins the reclaimer thread; a later retire starts a new one
+void OverlaysLayerStopReclaimer();
+
+// Per-thread direct-mapped caches sit in front of the Borrow lookups.
+// Removing any handle info bumps the generation, invalidating all of them.
+extern std::atomic<uint64_t> gOverlaysLayerHandleInfoRemoveGeneration;
+constexpr uint32_t OverlaysLayerLookupCacheSize = 8;
+
+inline uint32_t OverlaysLayerLookupCacheIndex(uint64_t handle)
+{
+    return (uint32_t)((handle ^ (handle >> 7) ^ (handle >> 17)) % OverlaysLayerLookupCacheSize);
+}
+
 // Header laid into the shared memory tracking the RPC type, the result,
 // and all pointers inside the shared memory which have to be fixed up
 // passing from Remote to Host and then back
@@ -377,134 +418,580 @@ void OverlaysLayerRemoveXrSwapchainHandleInfo(XrSwapchain localHandle);
 void OverlaysLayerRemoveXrActionHandleInfo(XrAction localHandle);
 void OverlaysLayerRemoveXrActionSetHandleInfo(XrActionSet actionSet);
 void OverlaysLayerRemoveXrSessionHandleInfo(XrSession session);
+void OverlaysLayerRemoveXrDebugUtilsMessengerEXTHandleInfo(XrDebugUtilsMessengerEXT messenger);
 void OverlaysLayerRemoveXrInstanceHandleInfo(XrInstance instance);
 
-enum OpenXRCommand {
-    BEGIN_SESSION,
-    WAIT_FRAME,
-    END_SESSION,
-    REQUEST_EXIT_SESSION,
+// Swapchain image backends ------------------------------------------------
+
+// How an overlay's swapchain images are allocated, shared with Main, and
+// copied into Main's runtime images.  The overlay session's graphics binding
+// picks the backend; Main's runtime images are always D3D11.
+enum SwapchainImageBackend
+{
+    SWAPCHAIN_IMAGE_BACKEND_D3D11,      // overlay renders to shared D3D11 textures, handed off with shared fences
+    SWAPCHAIN_IMAGE_BACKEND_CPU,        // overlay writes shared memory pixel buffers (XrGraphicsBindingCpuEXTX)
 };
 
-enum SessionLossState {
-    NOT_LOST,
-    LOSS_PENDING,
-    LOST,
+// Images pass between the processes like a keyed mutex: the side releasing an
+// image names which side may acquire it next.  The overlay owns an image from
+// its xrWaitSwapchainImage to its xrReleaseSwapchainImage; Main owns it from
+// then until it serves the overlay's next xrWaitSwapchainImage for that image.
+enum SwapchainImageOwner
+{
+    SWAPCHAIN_IMAGE_OWNER_OVERLAY = 0,
+    SWAPCHAIN_IMAGE_OWNER_MAIN = 1,
 };
 
-typedef std::pair<bool, XrSessionState> OptionalSessionStateChange;
+enum SwapchainImageHandoff
+{
+    SWAPCHAIN_IMAGE_HANDOFF_DONE,
+    SWAPCHAIN_IMAGE_HANDOFF_TIMEOUT,    // the other side still holds it
+    SWAPCHAIN_IMAGE_HANDOFF_FAILED,
+};
 
-struct MainSessionSessionState;
+// Overlay side: the images the overlay app renders into
+struct OverlaySwapchainImages
+{
+    virtual ~OverlaySwapchainImages() {}
+    // Allocates the images and duplicates their handles into Main's process
+    virtual bool Create(XrInstance instance, uint32_t count, HANDLE mainProcessHandle) = 0;
+    virtual uint32_t GetCount() = 0;
+    // Main's handle for the image, sent with the wait and release RPCs
+    virtual HANDLE GetSharedHandle(uint32_t index) = 0;
+    // Main's handle for what the image is handed off with, if it's a separate object; sent alongside
+    virtual HANDLE GetSharedSyncHandle(uint32_t index) { return NULL; }
+    // Fills the app's XrSwapchainImage*; false if the app used the wrong structure type
+    virtual bool GetImages(XrInstance instance, uint32_t count, XrSwapchainImageBaseHeader* images) = 0;
+    virtual SwapchainImageHandoff Acquire(uint32_t index, SwapchainImageOwner owner, DWORD timeoutMs) = 0;
+    virtual bool Release(uint32_t index, SwapchainImageOwner owner) = 0;
+
+    typedef std::shared_ptr<OverlaySwapchainImages> Ptr;
+};
 
-struct SessionStateTracker
+// Part of a runtime image to bring up to date from the overlay's image
+struct SwapchainImageDirtyRegion
 {
-    SessionLossState lossState = NOT_LOST;
-    XrSessionState sessionState = XR_SESSION_STATE_UNKNOWN;
-    bool isRunning = false;
-    bool exitRequested = false;
+    constexpr static size_t maxRects = 16;  // past this, copy the whole image
 
-    SessionStateTracker()
-    {
-    }
+    bool whole = true;
+    std::vector<XrRect2Di> rects;
+};
 
-    void DoCommand(OpenXRCommand command)
+// Main side: the overlay's images opened from their handles, and the
+// runtime's images.  Both are addressed by the runtime's image index, which
+// the overlay uses for its own images too.
+struct MainSwapchainImages
+{
+    virtual ~MainSwapchainImages() {}
+    // Opens the overlay's image "index" and its sync object the first time Main is sent their handles
+    virtual bool OpenSourceImage(uint32_t index, HANDLE sourceImage, HANDLE sourceSync) = 0;
+    virtual SwapchainImageHandoff Acquire(uint32_t index, SwapchainImageOwner owner, DWORD timeoutMs) = 0;
+    virtual bool Release(uint32_t index, SwapchainImageOwner owner) = 0;
+    // Makes Main's GPU wait on its immediate context for the overlay's rendering into image "index",
+    // for images handed off on the GPU; before the image is used there
+    virtual bool WaitForOverlayRendering(uint32_t index) { return true; }
+    // Caller has acquired the overlay's image "index" for Main and the same index from the runtime;
+    // context is Main's immediate context or a deferred context on Main's device
+    virtual bool CopyToRuntimeImage(uint32_t index, const SwapchainImageDirtyRegion& region, ID3D11DeviceContext* context) = 0;
+    // Duplicates the runtime's images into processHandle's process, if the runtime made them shareable
+    virtual bool ExportRuntimeImages(HANDLE processHandle, std::vector<HANDLE>& exported) { return false; }
+
+    typedef std::shared_ptr<MainSwapchainImages> Ptr;
+};
+
+// Overlay side: shared textures kept after their swapchain is destroyed, so
+// a swapchain created later with the same description takes them instead of
+// creating and sharing new ones.  Textures returned least recently are
+// released once the pool holds more than capacityBytes.
+struct SharedTexturePool
+{
+    struct Key
     {
-        if(command == BEGIN_SESSION) {
-            isRunning = true;
-        } else if (command == END_SESSION) {
-            isRunning = false;
-        } else if (command == REQUEST_EXIT_SESSION) {
-            exitRequested = true;
+        DXGI_FORMAT             format;
+        uint32_t                width;
+        uint32_t                height;
+        uint32_t                sampleCount;
+        XrSwapchainUsageFlags   usageFlags;
+
+        bool operator==(const Key& other) const
+        {
+            return std::tie(format, width, height, sampleCount, usageFlags) == std::tie(other.format, other.width, other.height, other.sampleCount, other.usageFlags);
         }
-    }
+    };
 
-    void DoSessionLost()
+    struct Texture
     {
-        lossState = LOST;
-    }
+        ID3D11Texture2D*    texture = nullptr;
+        HANDLE              localHandle = NULL;     // from CreateSharedHandle; duplicated into Main for each swapchain
 
-    SessionLossState GetLossState()
+        void Free();
+    };
+
+    struct Entry
     {
-        return lossState;
-    }
+        Key         key;
+        Texture     texture;
+        uint64_t    bytes;
+    };
+
+    std::mutex          mutex;
+    uint64_t            capacityBytes;
+    uint64_t            pooledBytes = 0;
+    std::list<Entry>    entries;        // most recently returned first
+
+    SharedTexturePool(uint64_t capacityBytes_) :
+        capacityBytes(capacityBytes_)
+    {}
+    ~SharedTexturePool();
+
+    // Fills "texture" with the most recently returned match, if any
+    bool Take(const Key& key, Texture& texture);
+    // "texture" must be done being read by Main, so it can be rendered into like a new one
+    void Give(const Key& key, const Texture& texture, uint64_t bytes);
 
-    OptionalSessionStateChange GetAndDoPendingStateChange(MainSessionSessionState *mainSession);
+    typedef std::shared_ptr<SharedTexturePool> Ptr;
 };
 
+// Overlay sessions' SharedTexturePool capacity, 0 to not pool
+extern uint64_t gSharedTexturePoolBytes;
 
-struct MainSessionSessionState : public SessionStateTracker
+// Returns 0 for formats without a fixed size per pixel, such as video formats
+uint32_t GetDXGIFormatBitsPerPixel(DXGI_FORMAT format);
+
+// Each image has a shared fence.  The overlay's k-th release of an image
+// signals 2k-1 on its GPU after its rendering; Main's GPU waits for that
+// before copying, and signals 2k once Main gives the image back, which the
+// overlay's GPU waits for before rendering into it again.  Neither CPU waits.
+struct D3D11OverlaySwapchainImages : public OverlaySwapchainImages
 {
-    XrTime currentTime;
-    bool hasCalledWaitFrame = false;
-    std::shared_ptr<XrFrameState> savedFrameState;
+    ID3D11Device*                   d3d11;
+    ID3D11DeviceContext4*           d3d11Context4 = nullptr;
+    int                             width;
+    int                             height;
+    DXGI_FORMAT                     format;
+    SharedTexturePool::Key          poolKey;
+    std::weak_ptr<SharedTexturePool> pool;      // textures go back here on destruction if it's still around
+    std::vector<ID3D11Texture2D*>   textures;
+    std::vector<HANDLE>             localHandles;
+    std::vector<HANDLE>             handles;
+    std::vector<ID3D11Fence*>       fences;
+    std::vector<HANDLE>             syncHandles;    // Main's handles to "fences"
+    std::vector<uint64_t>           releaseCounts;  // k above
+    std::vector<bool>               overlayHolds;   // acquired by the overlay and not yet released
+
+    D3D11OverlaySwapchainImages(ID3D11Device* d3d11_, const XrSwapchainCreateInfo* createInfo, SharedTexturePool::Ptr pool_ = nullptr) :
+        d3d11(d3d11_),
+        width(createInfo->width),
+        height(createInfo->height),
+        format(static_cast<DXGI_FORMAT>(createInfo->format)),
+        poolKey { format, createInfo->width, createInfo->height, createInfo->sampleCount, createInfo->usageFlags },
+        pool(pool_)
+    {}
+    ~D3D11OverlaySwapchainImages();
+
+    // Makes texture "index" and its local shared handle
+    bool CreateTexture(uint32_t index);
+    // Makes fence "index" and duplicates its handle into Main
+    bool CreateSharedFence(ID3D11Device5* device5, uint32_t index, HANDLE mainProcessHandle);
+    // False if Main may still be reading texture "index"
+    bool ResetForPool(uint32_t index);
+
+    bool Create(XrInstance instance, uint32_t count, HANDLE mainProcessHandle) override;
+    uint32_t GetCount() override { return (uint32_t)textures.size(); }
+    HANDLE GetSharedHandle(uint32_t index) override { return handles[index]; }
+    HANDLE GetSharedSyncHandle(uint32_t index) override { return syncHandles[index]; }
+    bool GetImages(XrInstance instance, uint32_t count, XrSwapchainImageBaseHeader* images) override;
+    SwapchainImageHandoff Acquire(uint32_t index, SwapchainImageOwner owner, DWORD timeoutMs) override;
+    bool Release(uint32_t index, SwapchainImageOwner owner) override;
+};
 
-    MainSessionSessionState()
+struct D3D11MainSwapchainImages : public MainSwapchainImages
+{
+    // Everything the per-frame path needs, resolved when the image is opened
+    struct SourceImage
     {
-    }
+        HANDLE              handle = NULL;
+        ID3D11Texture2D*    texture = nullptr;
+        HANDLE              syncHandle = NULL;
+        ID3D11Fence*        fence = nullptr;
+        uint64_t            releaseCount = 0;   // k in D3D11OverlaySwapchainImages
+    };
+
+    ID3D11Device1*                  d3d11Device;
+    ID3D11Device5*                  d3d11Device5 = nullptr;
+    ID3D11DeviceContext4*           immediateContext4 = nullptr;
+    std::vector<ID3D11Texture2D*>   runtimeImages;
+    std::vector<SourceImage>        sourceImages;
+
+    D3D11MainSwapchainImages(ID3D11Device* d3d11Device_, const std::vector<ID3D11Texture2D*>& runtimeImages_);
+    ~D3D11MainSwapchainImages();
+    void CloseSourceImage(SourceImage& image);
+
+    bool OpenSourceImage(uint32_t index, HANDLE sourceImage, HANDLE sourceSync) override;
+    SwapchainImageHandoff Acquire(uint32_t index, SwapchainImageOwner owner, DWORD timeoutMs) override;
+    bool Release(uint32_t index, SwapchainImageOwner owner) override;
+    bool WaitForOverlayRendering(uint32_t index) override;
+    bool CopyToRuntimeImage(uint32_t index, const SwapchainImageDirtyRegion& region, ID3D11DeviceContext* context) override;
+    bool ExportRuntimeImages(HANDLE processHandle, std::vector<HANDLE>& exported) override;
+};
+
+// Zero copy: the overlay renders into Main's runtime images, opened from
+// handles Main exported.  Rotation is the runtime's index from
+// xrAcquireSwapchainImage, as with the copy path.  The runtime's
+// xrWaitSwapchainImage in Main makes an image writable; the overlay signals
+// a shared fence on release, and Main's GPU waits for it before Main asks
+// for the runtime's xrReleaseSwapchainImage.
+struct ExportedOverlaySwapchainImages : public OverlaySwapchainImages
+{
+    ID3D11Device*                   d3d11;
+    std::vector<HANDLE>             handles;
+    std::vector<ID3D11Texture2D*>   textures;
+    ID3D11DeviceContext4*           d3d11Context4 = nullptr;
+    ID3D11Fence*                    renderingFence = nullptr;
+    UINT64                          renderingFenceValue = 0;    // releases so far
+    HANDLE                          syncHandle = NULL;          // Main's handle to renderingFence
+
+    ExportedOverlaySwapchainImages(ID3D11Device* d3d11_, const std::vector<HANDLE>& handles_) :
+        d3d11(d3d11_),
+        handles(handles_)
+    {}
+    ~ExportedOverlaySwapchainImages();
+
+    bool Create(XrInstance instance, uint32_t count, HANDLE mainProcessHandle) override;
+    uint32_t GetCount() override { return (uint32_t)textures.size(); }
+    HANDLE GetSharedHandle(uint32_t index) override { return handles[index]; }
+    HANDLE GetSharedSyncHandle(uint32_t index) override { return syncHandle; }
+    bool GetImages(XrInstance instance, uint32_t count, XrSwapchainImageBaseHeader* images) override;
+    SwapchainImageHandoff Acquire(uint32_t index, SwapchainImageOwner owner, DWORD timeoutMs) override { return SWAPCHAIN_IMAGE_HANDOFF_DONE; }
+    bool Release(uint32_t index, SwapchainImageOwner owner) override;
+};
+
+// Main's side of zero copy; besides the runtime's own wait and release,
+// only the GPU wait on the overlay's fence is needed
+struct ExportedMainSwapchainImages : public MainSwapchainImages
+{
+    ID3D11Device5*                  d3d11Device5 = nullptr;
+    ID3D11DeviceContext4*           immediateContext4 = nullptr;
+    HANDLE                          syncHandle = NULL;
+    ID3D11Fence*                    fence = nullptr;
+    uint64_t                        releaseCount = 0;
+    std::vector<uint64_t>           waitValues;     // the fence value each image's latest release signals
+
+    ExportedMainSwapchainImages(ID3D11Device* d3d11Device, uint32_t imageCount);
+    ~ExportedMainSwapchainImages();
+
+    bool OpenSourceImage(uint32_t index, HANDLE sourceImage, HANDLE sourceSync) override;
+    SwapchainImageHandoff Acquire(uint32_t index, SwapchainImageOwner owner, DWORD timeoutMs) override;
+    bool Release(uint32_t index, SwapchainImageOwner owner) override { return true; }
+    bool WaitForOverlayRendering(uint32_t index) override;
+    bool CopyToRuntimeImage(uint32_t index, const SwapchainImageDirtyRegion& region, ID3D11DeviceContext* context) override { return true; }
+};
+
+// Header at the start of each CPU image's shared memory section, followed by rows of pixels
+struct CpuSharedImageHeader
+{
+    constexpr static uint32_t HELD_BIT = 0x80000000;
+
+    std::atomic<uint32_t>   ownership;  // SwapchainImageOwner that may acquire next, | HELD_BIT while acquired
+    uint32_t                width;
+    uint32_t                height;
+    uint32_t                rowPitch;
+};
+
+struct CpuSharedImage
+{
+    HANDLE                  mapping = NULL;
+    HANDLE                  changed = NULL;     // auto-reset event set on every Release; duplicated into Main unnamed
+    CpuSharedImageHeader*   header = nullptr;
 
-    void DoStateChange(XrSessionState state, XrTime when)
+    unsigned char* GetPixels() { return reinterpret_cast<unsigned char*>(header) + sizeof(CpuSharedImageHeader); }
+    SwapchainImageHandoff Acquire(SwapchainImageOwner owner, DWORD timeoutMs);
+    void Release(SwapchainImageOwner owner);
+};
+
+struct CpuOverlaySwapchainImages : public OverlaySwapchainImages
+{
+    uint32_t                    width;
+    uint32_t                    height;
+    uint32_t                    bytesPerPixel;
+    std::vector<CpuSharedImage> images;
+    std::vector<HANDLE>         handles;
+    std::vector<HANDLE>         syncHandles;    // Main's handles to each image's "changed"
+
+    CpuOverlaySwapchainImages(const XrSwapchainCreateInfo* createInfo, uint32_t bytesPerPixel_) :
+        width(createInfo->width),
+        height(createInfo->height),
+        bytesPerPixel(bytesPerPixel_)
+    {}
+    ~CpuOverlaySwapchainImages();
+
+    bool Create(XrInstance instance, uint32_t count, HANDLE mainProcessHandle) override;
+    uint32_t GetCount() override { return (uint32_t)images.size(); }
+    HANDLE GetSharedHandle(uint32_t index) override { return handles[index]; }
+    HANDLE GetSharedSyncHandle(uint32_t index) override { return syncHandles[index]; }
+    bool GetImages(XrInstance instance, uint32_t count, XrSwapchainImageBaseHeader* images) override;
+    SwapchainImageHandoff Acquire(uint32_t index, SwapchainImageOwner owner, DWORD timeoutMs) override;
+    bool Release(uint32_t index, SwapchainImageOwner owner) override;
+};
+
+// Copies from shared memory into the runtime's D3D11 images with UpdateSubresource
+struct CpuMainSwapchainImages : public MainSwapchainImages
+{
+    ID3D11Device*                   d3d11Device;
+    std::vector<ID3D11Texture2D*>   runtimeImages;
+    std::vector<CpuSharedImage>     sourceImages;       // header is NULL until mapped
+    uint32_t                        bytesPerPixel;
+    uint32_t                        height;
+    uint32_t                        rowPitch;           // Main's own; the overlay can write the header's
+    bool                            deferredOffsetQuirk = false;
+
+    CpuMainSwapchainImages(ID3D11Device* d3d11Device_, const std::vector<ID3D11Texture2D*>& runtimeImages_);
+    ~CpuMainSwapchainImages();
+    void CloseSourceImage(CpuSharedImage& image);
+
+    bool OpenSourceImage(uint32_t index, HANDLE sourceImage, HANDLE sourceSync) override;
+    SwapchainImageHandoff Acquire(uint32_t index, SwapchainImageOwner owner, DWORD timeoutMs) override;
+    bool Release(uint32_t index, SwapchainImageOwner owner) override;
+    bool CopyToRuntimeImage(uint32_t index, const SwapchainImageDirtyRegion& region, ID3D11DeviceContext* context) override;
+};
+
+// Returns 0 if the CPU backend can't hold images of this format
+uint32_t GetCpuImageBytesPerPixel(DXGI_FORMAT format);
+
+// Main's view of one image of an overlay swapchain, as bits in SwapchainCachedData::imageState
+enum SwapchainImageStateBits : uint8_t
+{
+    SWAPCHAIN_IMAGE_STATE_ACQUIRED_BIT = 0x1,  // acquired from the runtime, not yet released
+    SWAPCHAIN_IMAGE_STATE_HELD_BIT = 0x2,      // Main holds the overlay's image until the overlay next waits on it
+    SWAPCHAIN_IMAGE_STATE_STALLED_BIT = 0x4,   // released by the overlay, but Main couldn't take it
+};
+
+struct MainImageCopyQueue;
+
+// Bookkeeping of SwapchainImages for copying remote SwapchainImages on ReleaseSwapchainImage
+struct SwapchainCachedData
+{
+    XrSwapchain swapchain;
+    MainSwapchainImages::Ptr images;
+    std::shared_ptr<MainImageCopyQueue> copyQueue;  // of the Main session this was created in
+    SwapchainImageIndexRing acquired;
+    std::vector<uint8_t>    imageState;             // SwapchainImageStateBits by image index
+    std::atomic<uint64_t>   lastCopyQueued = 0;     // copyQueue's sequence of the latest release
+    std::atomic<XrResult>   releaseFailure { XR_SUCCESS };  // a runtime xrReleaseSwapchainImage error not yet returned to the overlay
+    std::atomic<bool>       latestReleaseUncopied = false;  // the copy queue couldn't take the latest release's image
+    uint64_t                releaseCount = 0;       // the overlay's RPC thread reads and writes these two
+    uint64_t                releaseCountAtSubmit = 0;
+    int32_t                 width;
+    int32_t                 height;
+    std::mutex              dirtyMutex;             // the overlay's RPC thread and the copy queue both update runtimeImageDirty
+    std::vector<SwapchainImageDirtyRegion> runtimeImageDirty;  // what each runtime image lacks of the overlay's latest release
+
+    SwapchainCachedData(XrSwapchain swapchain_, MainSwapchainImages::Ptr images_, std::shared_ptr<MainImageCopyQueue> copyQueue_, uint32_t imageCount, int32_t width_, int32_t height_) :
+        swapchain(swapchain_),
+        images(images_),
+        copyQueue(copyQueue_),
+        acquired(imageCount),
+        imageState(imageCount),
+        width(width_),
+        height(height_),
+        runtimeImageDirty(imageCount)
     {
-        sessionState = state;
-        currentTime = when;
     }
 
-    void DoCommand(OpenXRCommand command)
+    // Marks what an overlay release changed, all of the image if "dirty" is NULL, in every runtime image
+    void AddDirtyRects(const XrSwapchainImageDirtyRectsEXTX* dirty);
+    // What runtimeIndex needs copied now; it's then up to date
+    SwapchainImageDirtyRegion TakeDirtyRegion(uint32_t runtimeIndex);
+    // runtimeIndex was released without the copy TakeDirtyRegion was for
+    void MarkWholeDirty(uint32_t runtimeIndex);
+
+    ~SwapchainCachedData();
+
+    typedef std::shared_ptr<SwapchainCachedData> Ptr;
+};
+
+struct OverlaysLayerXrSwapchainHandleInfo;
+struct OverlaysLayerXrSpaceHandleInfo;
+
+// Main may still submit, or the runtime may still be reading from, this overlay swapchain
+bool OverlaysLayerSwapchainInFlight(const OverlaysLayerXrSwapchainHandleInfo* info);
+
+// An overlay's xrReleaseSwapchainImage, finished by MainImageCopyQueue
+struct MainImageCopy
+{
+    OverlaysLayerXrSwapchainHandleInfo* swapchainInfo;  // kept alive by OverlaysLayerSwapchainInFlight
+    uint32_t runtimeIndex;
+    bool handedOff;                                     // false if the release RPC couldn't take the overlay's image; retried once
+    SwapchainImageDirtyRegion region;
+    std::shared_ptr<XrSwapchainImageReleaseInfo> releaseInfo;
+    uint64_t sequence;
+};
+
+// Copies released overlay images into the runtime's images and releases
+// those to the runtime, on one worker thread for all overlays.  Each batch is
+// recorded on a deferred context and executed on Main's immediate context as
+// a single command list, so RPC threads don't issue commands on the app's
+// context or wait on the runtime.  Until a release is done, the overlay's
+// next xrAcquireSwapchainImage or xrWaitSwapchainImage on that swapchain and
+// Main's xrEndFrame wait for it.
+struct MainImageCopyQueue
+{
+    ID3D11Device*           d3d11Device;
+    ID3D11DeviceContext*    deferredContext = nullptr;  // if NULL, batches are recorded on the immediate context
+    std::thread             thread;
+
+    std::mutex              mutex;
+    std::condition_variable queued;
+    std::condition_variable completed;
+    std::vector<MainImageCopy> pending;
+    uint64_t                lastQueued = 0;
+    std::atomic<uint64_t>   lastCompleted = 0;
+    bool                    stopping = false;   // later copies are dropped and marked done
+
+    MainImageCopyQueue(ID3D11Device* d3d11Device_);
+    ~MainImageCopyQueue();
+
+    void Start();
+    // Finishes what's queued, joins the thread, and releases Main's device; before Main's session is destroyed
+    void Stop();
+
+    // Returns the copy's sequence number
+    uint64_t Enqueue(OverlaysLayerXrSwapchainHandleInfo* swapchainInfo, uint32_t runtimeIndex, bool handedOff, SwapchainImageDirtyRegion&& region, std::shared_ptr<XrSwapchainImageReleaseInfo> releaseInfo);
+    bool IsDone(uint64_t sequence) { return sequence <= lastCompleted; }
+    void WaitFor(uint64_t sequence);
+    void WaitForAll();
+    void ThreadBody();
+
+    typedef std::shared_ptr<MainImageCopyQueue> Ptr;
+};
+
+// Grow-only bump allocator that is reset and reused every frame, so once it
+// has grown to a frame's worth of struct copies it stops allocating.
+struct ScratchArena
+{
+    constexpr static size_t memberAlignment = 8;
+    constexpr static size_t initialSize = 64 * 1024;
+
+    std::unique_ptr<unsigned char[]> block;
+    size_t size = 0;
+    size_t used = 0;
+
+    // Allocations that didn't fit this frame; folded into "block" on reset()
+    std::vector<std::unique_ptr<unsigned char[]>> overflow;
+    size_t overflowSize = 0;
+
+    void* allocate(size_t s)
     {
-        if (command == WAIT_FRAME) {
-            // XXX saved predicted times updated separately
-        } else {
-            if(command == BEGIN_SESSION) {
-                hasCalledWaitFrame = true; // XXX this is where hasCalledWaitFrame was updated in old layer :shrug:
-            }
-            SessionStateTracker::DoCommand(command);
+        s = (s + memberAlignment - 1) & ~(memberAlignment - 1);
+        if(used + s <= size) {
+            void* p = block.get() + used;
+            used += s;
+            return p;
         }
+        overflow.emplace_back(new unsigned char[s]);
+        overflowSize += s;
+        return overflow.back().get();
     }
 
-    void IncrementPredictedDisplayTime()
+    // Everything previously allocated is invalid after this
+    void reset()
     {
-        if(savedFrameState) {
-            savedFrameState->predictedDisplayTime += 1; // XXX This is legal, but not really what we want
+        if(!block || !overflow.empty()) {
+            size = (std::max)(initialSize, (size + overflowSize) * 2);
+            block.reset(new unsigned char[size]);
+            overflow.clear();
+            overflowSize = 0;
         }
+        used = 0;
     }
+};
 
+// An overlay quad layer re-posed by Main's xrEndFrame from XrCompositionLayerLateLatchEXTX
+struct OverlayLateLatchedLayer
+{
+    XrCompositionLayerQuad* layer;  // an overlay's restored copy; only Main's xrEndFrame writes the pose
+    std::shared_ptr<const XrCompositionLayerLateLatchEXTX> latch;  // unlinked from the layer so the runtime doesn't see it
 };
 
-// Bookkeeping of SwapchainImages for copying remote SwapchainImages on ReleaseSwapchainImage
-struct SwapchainCachedData
+// Times one frame call into "ring" (if not null) when it goes out of scope.
+// Code below it on the same thread brackets runtime calls or waits on Main
+// with the static DownchainBegin() and DownchainEnd().
+struct FrameTimingScope
 {
-    enum {
-        KEYED_MUTEX_OVERLAY = 0,
-        KEYED_MUTEX_MAIN = 1,
-    };
+    static thread_local FrameTimingScope* current;
 
-    XrSwapchain swapchain;
-    std::vector<ID3D11Texture2D*> swapchainImages;
-    std::set<HANDLE> remoteImagesAcquired;
-    std::unordered_map<HANDLE, ID3D11Texture2D*> handleTextureMap;
-    std::vector<uint32_t>   acquired;
+    FrameTimingRing* ring;
+    XrFrameTimingPhaseEXTX phase;
+    FrameTimingScope* outer;
+    int64_t start;
+    int64_t downchainStart = 0;
+    int64_t downchainDuration = 0;
 
-    SwapchainCachedData(XrSwapchain swapchain_, const std::vector<ID3D11Texture2D*>& swapchainImages_) :
-        swapchain(swapchain_),
-        swapchainImages(swapchainImages_)
+    static int64_t Now()
     {
-        for(auto texture : swapchainImages) {
-            texture->AddRef();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    FrameTimingScope(FrameTimingRing* ring, XrFrameTimingPhaseEXTX phase) :
+        ring(ring),
+        phase(phase),
+        outer(current),
+        start(Now())
+    {
+        current = this;
+    }
+
+    ~FrameTimingScope()
+    {
+        current = outer;
+        if(ring) {
+            ring->Record(phase, gMainFrameTickSequence, start, Now() - start, downchainDuration);
         }
     }
 
-    ~SwapchainCachedData();
-    ID3D11Texture2D* getSharedTexture(ID3D11Device *d3d11Device, HANDLE sourceHandle);
+    FrameTimingScope(const FrameTimingScope&) = delete;
+    FrameTimingScope& operator=(const FrameTimingScope&) = delete;
 
-    typedef std::shared_ptr<SwapchainCachedData> Ptr;
+    static void DownchainBegin()
+    {
+        if(current) {
+            current->downchainStart = Now();
+        }
+    }
+
+    static void DownchainEnd()
+    {
+        if(current) {
+            current->downchainDuration += Now() - current->downchainStart;
+        }
+    }
 };
 
-struct OverlaysLayerXrSwapchainHandleInfo;
+struct MainAsOverlaySessionContext;
 
 struct MainSessionContext
 {
     XrSession session;
     MainSessionSessionState sessionState;
-    std::set<std::shared_ptr<OverlaysLayerXrSwapchainHandleInfo>> swapchainsInFlight;
+
+    // Main's own xrWaitFrame, xrBeginFrame, and xrEndFrame
+    FrameTimingRing frameTimings;
+
+    // Reused by Main's xrEndFrame; the app externally synchronizes xrEndFrame so these need no lock
+    ScratchArena endFrameArena;
+    std::vector<const XrCompositionLayerBaseHeader*> endFrameLayers;
+    std::vector<const OverlayLateLatchedLayer*> endFrameLateLatches;
+
+    std::vector<MainAsOverlaySessionContext*> endFrameBudgetOrder;
+
+    // Main's instance enabled XR_KHR_composition_layer_color_scale_bias, so stale overlays can be faded
+    bool colorScaleBiasEnabled = false;
+
+    // From XrSystemGraphicsProperties; all layers Main submits must fit
+    uint32_t maxLayerCount = XR_MIN_COMPOSITION_LAYERS_SUPPORTED;
+
+    // Set before overlays can connect
+    MainImageCopyQueue::Ptr imageCopies;
 
     MainSessionContext(XrSession session) :
         session(session)
@@ -523,7 +1010,8 @@ typedef std::shared_ptr<XrEventDataBuffer> EventDataBufferPtr;
 
 struct MainAsOverlaySessionContext
 {
-    uint32_t sessionLayersPlacement;
+    const SwapchainImageBackend imageBackend;   // how the overlay's swapchain images reach Main
+    const uint32_t sessionLayersPlacement;  // immutable so depth ordering can cache it
     bool relaxedDisplayTime;
     // local handles so they can be looked up in our tracking maps
     std::set<XrSpace> localSpaces; // use swapchainMap? 
@@ -531,11 +1019,64 @@ struct MainAsOverlaySessionContext
 
     SessionStateTracker sessionState;
 
+    // This overlay's frame calls as they arrive in Main
+    FrameTimingRing frameTimings;
+
+    // Last frame tick and display time handed to this overlay by xrWaitFrame
+    uint64_t lastFrameTickSequence = 0;
+    XrTime lastPredictedDisplayTime = 0;
+
+    // From XrOverlayUpdateRateInfoEXTX; xrWaitFrame asks for rendering only
+    // once Main's frame tick reaches nextRenderSequence
+    std::atomic<uint32_t> frameInterval = 1;
+    uint64_t nextRenderSequence = 0;
+
     constexpr static int maxEventsSavedForOverlay = 16;
     std::queue<EventDataBufferPtr> eventsSaved;
 
     constexpr static int maxOverlayCompositionLayers = 16;
-    std::vector<std::shared_ptr<const XrCompositionLayerBaseHeader>> overlayLayers;
+    // One xrEndFrame's layers, copied with actual handles already restored so
+    // Main can pass them straight downchain.  Each swapchain entry holds one
+    // layerSetsReferencing count and holding the space infos keeps those alive,
+    // so the runtime objects outlive a destroy while Main may still submit them.
+    struct LayerSet
+    {
+        std::vector<std::shared_ptr<const XrCompositionLayerBaseHeader>> layers;
+        std::vector<OverlaysLayerXrSwapchainHandleInfo*> swapchains;
+        std::set<std::shared_ptr<OverlaysLayerXrSpaceHandleInfo>> spaces;
+        std::vector<OverlayLateLatchedLayer> lateLatches;
+        std::chrono::steady_clock::time_point submitted;
+
+        LayerSet() = default;
+        LayerSet(const LayerSet&) = delete;
+        LayerSet& operator=(const LayerSet&) = delete;
+        ~LayerSet() { clear(); }
+
+        void clear();
+    };
+    // Written by this overlay's RPC thread in xrEndFrame, read by Main's xrEndFrame
+    TripleBuffer<LayerSet> overlayLayers;
+
+    // From XrOverlayStaleLayerPolicyInfoEXTX and XrOverlaySessionPriorityInfoEXTX at session creation
+    XrOverlayStaleLayerPolicyEXTX stalePolicy = XR_OVERLAY_STALE_LAYER_POLICY_REUSE_EXTX;
+    uint32_t staleFrameLimit = 0;
+    uint32_t importance = 0;
+
+    // Only Main's xrEndFrame uses these
+    uint32_t framesSinceSubmission = 0;
+    const LayerSet* frameLayers = nullptr;  // what this frame submits, nullptr if withheld
+    float frameAlpha = 1.0f;
+    bool culledLastFrame = false;
+
+    // Counters reported by xrEnumerateOverlayStatsEXTX
+    std::atomic<uint64_t> submittedFrames = 0;
+    std::atomic<uint64_t> staticFrames = 0;
+    std::atomic<uint64_t> staleFrames = 0;
+    std::atomic<uint64_t> droppedFrames = 0;
+    std::atomic<uint64_t> culledFrames = 0;
+    std::atomic<uint64_t> stalledFrames = 0;
+    std::atomic<XrDuration> lastSubmitLatency = 0;
+    std::atomic<XrDuration> maxSubmitLatency = 0;
 
     // This structure needs to be locked because Main could Destroy its
     // shared XrSession and all of its children and that would need to go
@@ -549,18 +1090,43 @@ struct MainAsOverlaySessionContext
         return std::unique_lock<std::recursive_mutex>(mutex);
     }
 
-    MainAsOverlaySessionContext(const XrSessionCreateInfoOverlayEXTX* createInfoOverlay) :
+    MainAsOverlaySessionContext(const XrSessionCreateInfoOverlayEXTX* createInfoOverlay, SwapchainImageBackend imageBackend) :
+        imageBackend(imageBackend),
         sessionLayersPlacement(createInfoOverlay->sessionLayersPlacement),
         relaxedDisplayTime(createInfoOverlay->createFlags & XR_OVERLAY_SESSION_CREATE_RELAXED_DISPLAY_TIME_BIT_EXTX)
-    {}
+    {
+        for(auto p = reinterpret_cast<const XrBaseInStructure*>(createInfoOverlay->next); p; p = p->next) {
+            if(p->type == XR_TYPE_OVERLAY_STALE_LAYER_POLICY_INFO_EXTX) {
+                auto policyInfo = reinterpret_cast<const XrOverlayStaleLayerPolicyInfoEXTX*>(p);
+                stalePolicy = policyInfo->policy;
+                staleFrameLimit = policyInfo->staleFrameLimit;
+            } else if(p->type == XR_TYPE_OVERLAY_SESSION_PRIORITY_INFO_EXTX) {
+                importance = reinterpret_cast<const XrOverlaySessionPriorityInfoEXTX*>(p)->importance;
+            } else if(p->type == XR_TYPE_OVERLAY_UPDATE_RATE_INFO_EXTX) {
+                SetFrameInterval(reinterpret_cast<const XrOverlayUpdateRateInfoEXTX*>(p)->frameInterval);
+            }
+        }
+    }
+
+    void SetFrameInterval(uint32_t interval)
+    {
+        frameInterval = (std::max)(interval, 1u);
+    }
 
     ~MainAsOverlaySessionContext()
     {
+        // Can't let a handle already removed some other way throw out of a destructor
         for(auto s: localSpaces) {
-            OverlaysLayerRemoveXrSpaceHandleInfo(s);
+            try {
+                OverlaysLayerRemoveXrSpaceHandleInfo(s);
+            } catch (const OverlaysLayerXrException&) {
+            }
         }
         for(auto s: localSwapchains) {
-            OverlaysLayerRemoveXrSwapchainHandleInfo(s);
+            try {
+                OverlaysLayerRemoveXrSwapchainHandleInfo(s);
+            } catch (const OverlaysLayerXrException&) {
+            }
         }
     }
 
@@ -618,33 +1184,19 @@ uint64_t GetNextLocalHandle();
 struct OverlaySwapchain
 {
     XrSwapchain             swapchain;
-    std::vector<ID3D11Texture2D*> swapchainTextures;
-    std::vector<HANDLE>          swapchainHandles;
-    std::vector<uint32_t>   acquired;
+    OverlaySwapchainImages::Ptr images;
+    SwapchainImageIndexRing acquired;
     bool                    waited;
-    int                     width;
-    int                     height;
-    DXGI_FORMAT             format;
-
+    bool                    remoteWaited = false;   // Main waited on the runtime image but the handoff timed out
 
-    OverlaySwapchain(XrSwapchain sc, size_t count, const XrSwapchainCreateInfo* createInfo) :
+    OverlaySwapchain(XrSwapchain sc, OverlaySwapchainImages::Ptr images_, uint32_t imageCount) :
         swapchain(sc),
-        swapchainTextures(count),
-        swapchainHandles(count),
-        waited(false),
-        width(createInfo->width),
-        height(createInfo->height),
-        format(static_cast<DXGI_FORMAT>(createInfo->format))
+        images(images_),
+        acquired(imageCount),
+        waited(false)
     {
     }
-    bool CreateTextures(XrInstance instance, ID3D11Device *d3d11, DWORD mainProcessId);
-    ~OverlaySwapchain()
-    {
-        // XXX Need to AcquireSync from remote side?
-        for(int i = 0; i < swapchainTextures.size(); i++) {
-            swapchainTextures[i]->Release();
-        }
-    }
+    // XXX Need to AcquireSync from remote side before images are released?
     typedef std::shared_ptr<OverlaySwapchain> Ptr;
 };
 
@@ -966,15 +1518,21 @@ XrResult OverlaysLayerBeginFrameOverlay(XrInstance instance, XrSession session,
 XrResult OverlaysLayerAcquireSwapchainImageMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSwapchain swapchain, const XrSwapchainImageAcquireInfo* acquireInfo, uint32_t *index);
 XrResult OverlaysLayerAcquireSwapchainImageOverlay(XrInstance instance, XrSwapchain swapchain, const XrSwapchainImageAcquireInfo* acquireInfo, uint32_t *index);
 
-XrResult OverlaysLayerWaitSwapchainImageMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSwapchain swapchain, const XrSwapchainImageWaitInfo* waitInfo, HANDLE sourceImage);
+XrResult OverlaysLayerWaitSwapchainImageMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSwapchain swapchain, const XrSwapchainImageWaitInfo* waitInfo, HANDLE sourceImage, HANDLE sourceSync);
 XrResult OverlaysLayerWaitSwapchainImageOverlay(XrInstance instance, XrSwapchain swapchain, const XrSwapchainImageWaitInfo* waitInfo);
 
-XrResult OverlaysLayerReleaseSwapchainImageMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSwapchain swapchain, const XrSwapchainImageReleaseInfo* waitInfo, HANDLE sourceImage);
+XrResult OverlaysLayerReleaseSwapchainImageMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSwapchain swapchain, const XrSwapchainImageReleaseInfo* waitInfo, HANDLE sourceImage, HANDLE sourceSync);
 XrResult OverlaysLayerReleaseSwapchainImageOverlay(XrInstance instance, XrSwapchain swapchain, const XrSwapchainImageReleaseInfo* waitInfo);
 
+XrResult OverlaysLayerExportSwapchainImagesMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSwapchain swapchain, uint32_t handleCapacityInput, uint32_t* handleCountOutput, uint64_t* handles);
+
 XrResult OverlaysLayerEndFrameMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSession session, const XrFrameEndInfo* frameEndInfo);
 XrResult OverlaysLayerEndFrame(XrSession session, const XrFrameEndInfo* frameEndInfo);
 
+XrResult XRAPI_CALL OverlaysLayerEnumerateOverlayStatsEXTX(XrInstance instance, uint32_t statsCapacityInput, uint32_t* statsCountOutput, XrOverlayStatsEXTX* stats);
+XrResult XRAPI_CALL OverlaysLayerEnumerateFrameTimingsEXTX(XrInstance instance, uint32_t timingCapacityInput, uint32_t* timingCountOutput, XrFrameTimingEXTX* timings);
+XrResult XRAPI_CALL OverlaysLayerDumpFrameTimingsEXTX(XrInstance instance, const char* path);
+
 XrResult OverlaysLayerEnumerateReferenceSpacesMainAsOverlay(ConnectionToOverlay::Ptr connection, XrSession session, uint32_t spaceCapacityInput, uint32_t* spaceCountOutput, XrReferenceSpaceType* spaces);
 XrResult OverlaysLayerEnumerateReferenceSpacesOverlay(XrInstance instance, XrSession session, uint32_t spaceCapacityInput, uint32_t* spaceCountOutput, XrReferenceSpaceType* spaces);
 
@@ -0,0 +1,327 @@
+#ifndef _SESSION_STATE_H_
+#define _SESSION_STATE_H_
+
+// Overlay and Main session state tracking, kept free of Windows and graphics
+// API dependencies so the transitions can be tested on any platform.
+
+#include <openxr/openxr.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+enum OpenXRCommand {
+    BEGIN_SESSION,
+    WAIT_FRAME,
+    END_SESSION,
+    REQUEST_EXIT_SESSION,
+};
+
+enum SessionLossState {
+    NOT_LOST,
+    LOSS_PENDING,
+    LOST,
+};
+
+typedef std::pair<bool, XrSessionState> OptionalSessionStateChange;
+
+struct MainSessionSessionState;
+
+// Session state, loss state, and command flags packed into one word so the
+// Main RPC threads and PollEvent can read and transition them without locks
+struct SessionStateWord
+{
+    XrSessionState sessionState = XR_SESSION_STATE_UNKNOWN;
+    SessionLossState lossState = NOT_LOST;
+    bool isRunning = false;
+    bool exitRequested = false;
+    bool hasCalledWaitFrame = false;
+
+    enum : uint64_t {
+        STATE_MASK = 0xFF,
+        LOSS_SHIFT = 8,
+        LOSS_MASK = 0x3,
+        RUNNING_BIT = 1 << 10,
+        EXIT_REQUESTED_BIT = 1 << 11,
+        CALLED_WAIT_FRAME_BIT = 1 << 12,
+        VISIBLE_BIT = 1 << 13,          // derived from sessionState
+        FOCUSED_BIT = 1 << 14,          // derived from sessionState
+    };
+
+    uint64_t Pack() const
+    {
+        uint64_t word = (uint64_t)sessionState & STATE_MASK;
+        word |= ((uint64_t)lossState & LOSS_MASK) << LOSS_SHIFT;
+        word |= isRunning ? RUNNING_BIT : 0;
+        word |= exitRequested ? EXIT_REQUESTED_BIT : 0;
+        word |= hasCalledWaitFrame ? CALLED_WAIT_FRAME_BIT : 0;
+        word |= ((sessionState == XR_SESSION_STATE_VISIBLE) || (sessionState == XR_SESSION_STATE_FOCUSED)) ? VISIBLE_BIT : 0;
+        word |= (sessionState == XR_SESSION_STATE_FOCUSED) ? FOCUSED_BIT : 0;
+        return word;
+    }
+
+    static SessionStateWord Unpack(uint64_t word)
+    {
+        SessionStateWord s;
+        s.sessionState = (XrSessionState)(word & STATE_MASK);
+        s.lossState = (SessionLossState)((word >> LOSS_SHIFT) & LOSS_MASK);
+        s.isRunning = (word & RUNNING_BIT) != 0;
+        s.exitRequested = (word & EXIT_REQUESTED_BIT) != 0;
+        s.hasCalledWaitFrame = (word & CALLED_WAIT_FRAME_BIT) != 0;
+        return s;
+    }
+};
+
+struct SessionStateTracker
+{
+    std::atomic<uint64_t> word { SessionStateWord().Pack() };
+
+    SessionStateTracker()
+    {
+    }
+
+    SessionStateWord Load() const
+    {
+        return SessionStateWord::Unpack(word.load());
+    }
+
+    // Apply "transition" with CAS until it lands on an unchanged word.
+    // "transition" returns false to leave the word alone.
+    // Returns the state that was installed (or observed, if left alone).
+    template <typename F>
+    std::pair<bool, SessionStateWord> Update(F transition)
+    {
+        uint64_t expected = word.load();
+        while(1) {
+            SessionStateWord s = SessionStateWord::Unpack(expected);
+            if(!transition(s)) {
+                return {false, SessionStateWord::Unpack(expected)};
+            }
+            if(word.compare_exchange_weak(expected, s.Pack())) {
+                return {true, s};
+            }
+        }
+    }
+
+    static bool ApplyCommand(SessionStateWord& s, OpenXRCommand command)
+    {
+        if(command == BEGIN_SESSION) {
+            s.isRunning = true;
+        } else if (command == END_SESSION) {
+            s.isRunning = false;
+        } else if (command == REQUEST_EXIT_SESSION) {
+            s.exitRequested = true;
+        }
+        return true;
+    }
+
+    void DoCommand(OpenXRCommand command)
+    {
+        Update([command](SessionStateWord& s){ return ApplyCommand(s, command); });
+    }
+
+    void DoSessionLost()
+    {
+        Update([](SessionStateWord& s){ s.lossState = LOST; return true; });
+    }
+
+    SessionLossState GetLossState() const
+    {
+        return Load().lossState;
+    }
+
+    XrSessionState GetSessionState() const
+    {
+        return Load().sessionState;
+    }
+
+    bool IsRunning() const
+    {
+        return Load().isRunning;
+    }
+
+    bool IsVisible() const
+    {
+        return (word.load() & SessionStateWord::VISIBLE_BIT) != 0;
+    }
+
+    bool IsFocused() const
+    {
+        return (word.load() & SessionStateWord::FOCUSED_BIT) != 0;
+    }
+
+    OptionalSessionStateChange GetAndDoPendingStateChange(MainSessionSessionState *mainSession);
+};
+
+
+// Sequence of the latest frame tick published by Main's xrWaitFrame
+extern std::atomic<uint64_t> gMainFrameTickSequence;
+
+struct MainSessionSessionState : public SessionStateTracker
+{
+    std::atomic<XrTime> currentTime = 0;
+    std::shared_ptr<XrFrameState> savedFrameState;
+
+    MainSessionSessionState()
+    {
+    }
+
+    void DoStateChange(XrSessionState state, XrTime when)
+    {
+        Update([state](SessionStateWord& s){ s.sessionState = state; return true; });
+        currentTime = when;
+    }
+
+    void DoCommand(OpenXRCommand command)
+    {
+        if (command == WAIT_FRAME) {
+            // XXX saved predicted times updated separately
+        } else {
+            Update([command](SessionStateWord& s){
+                if(command == BEGIN_SESSION) {
+                    s.hasCalledWaitFrame = true; // XXX this is where hasCalledWaitFrame was updated in old layer :shrug:
+                }
+                return ApplyCommand(s, command);
+            });
+        }
+    }
+
+    // Frame tick published by Main's xrWaitFrame; overlay xrWaitFrame blocks on this
+    struct FrameTick
+    {
+        uint64_t sequence = 0;
+        XrTime predictedDisplayTime = 0;
+        XrDuration predictedDisplayPeriod = 0;
+        XrBool32 shouldRender = XR_FALSE;
+    };
+
+    // Don't hold an overlay forever if Main stops calling xrWaitFrame
+    constexpr static int frameTickTimeoutMillis = 100;
+
+    std::mutex frameTickMutex;
+    std::condition_variable frameTickCondition;
+    FrameTick frameTick;
+
+    void PublishFrameTick(const XrFrameState* frameState)
+    {
+        {
+            std::unique_lock<std::mutex> lock(frameTickMutex);
+            frameTick.sequence++;
+            frameTick.predictedDisplayTime = frameState->predictedDisplayTime;
+            frameTick.predictedDisplayPeriod = frameState->predictedDisplayPeriod;
+            frameTick.shouldRender = frameState->shouldRender;
+            gMainFrameTickSequence = frameTick.sequence;
+        }
+        frameTickCondition.notify_all();
+    }
+
+    // Returns the latest tick; if "block", first waits (bounded) for a tick newer than lastSequence
+    FrameTick WaitFrameTick(uint64_t lastSequence, bool block)
+    {
+        std::unique_lock<std::mutex> lock(frameTickMutex);
+        if(block) {
+            frameTickCondition.wait_for(lock, std::chrono::milliseconds(frameTickTimeoutMillis), [&]{ return frameTick.sequence > lastSequence; });
+        }
+        return frameTick;
+    }
+
+};
+
+// Next overlay session state given the overlay's and Main's current state, or UNKNOWN if none
+inline XrSessionState GetPendingStateChange(const SessionStateWord& overlayState, const SessionStateWord& mainState)
+{
+    XrSessionState sessionState = overlayState.sessionState;
+    bool exitRequested = overlayState.exitRequested;
+    bool isRunning = overlayState.isRunning;
+
+    if((sessionState != XR_SESSION_STATE_LOSS_PENDING) &&
+        ((mainState.lossState == LOST) ||
+        (mainState.lossState == LOSS_PENDING))) {
+
+        return XR_SESSION_STATE_LOSS_PENDING;
+    }
+
+    switch(sessionState) {
+        case XR_SESSION_STATE_UNKNOWN:
+            if(mainState.sessionState != XR_SESSION_STATE_UNKNOWN) {
+                return XR_SESSION_STATE_IDLE;
+            }
+            break;
+
+        case XR_SESSION_STATE_IDLE:
+            if(exitRequested || (mainState.sessionState == XR_SESSION_STATE_EXITING)) {
+                return XR_SESSION_STATE_EXITING;
+            } else if(mainState.isRunning && mainState.hasCalledWaitFrame) {
+                return XR_SESSION_STATE_READY;
+            }
+            break;
+
+        case XR_SESSION_STATE_READY:
+            if(isRunning) {
+                return XR_SESSION_STATE_SYNCHRONIZED;
+            } 
+            break;
+
+        case XR_SESSION_STATE_SYNCHRONIZED:
+            if(exitRequested || !mainState.isRunning || (mainState.sessionState == XR_SESSION_STATE_STOPPING)) {
+                return XR_SESSION_STATE_STOPPING;
+            } else if((mainState.sessionState == XR_SESSION_STATE_VISIBLE) || (mainState.sessionState == XR_SESSION_STATE_FOCUSED)) {
+                return XR_SESSION_STATE_VISIBLE;
+            } 
+            break;
+
+        case XR_SESSION_STATE_VISIBLE:
+            if(exitRequested || !mainState.isRunning || (mainState.sessionState == XR_SESSION_STATE_STOPPING)) {
+                return XR_SESSION_STATE_SYNCHRONIZED;
+            } else if(mainState.sessionState == XR_SESSION_STATE_SYNCHRONIZED) {
+                return XR_SESSION_STATE_SYNCHRONIZED;
+            } else if(mainState.sessionState == XR_SESSION_STATE_FOCUSED) {
+                return XR_SESSION_STATE_FOCUSED;
+            }
+            break;
+
+        case XR_SESSION_STATE_FOCUSED:
+            if(exitRequested || !mainState.isRunning || (mainState.sessionState == XR_SESSION_STATE_STOPPING)) {
+                return XR_SESSION_STATE_VISIBLE;
+            } else if((mainState.sessionState == XR_SESSION_STATE_VISIBLE) || (mainState.sessionState == XR_SESSION_STATE_SYNCHRONIZED)) {
+                return XR_SESSION_STATE_VISIBLE;
+            }
+            break;
+
+        case XR_SESSION_STATE_STOPPING:
+            if(!isRunning) {
+                return XR_SESSION_STATE_IDLE;
+            }
+            break;
+
+        default:
+            // No other combination of states requires an Overlay SessionStateChange
+            break;
+    }
+
+    return XR_SESSION_STATE_UNKNOWN;
+}
+
+inline OptionalSessionStateChange SessionStateTracker::GetAndDoPendingStateChange(MainSessionSessionState *mainSession)
+{
+    SessionStateWord mainState = mainSession->Load();
+
+    auto [changed, newState] = Update([&mainState](SessionStateWord& s){
+        XrSessionState next = GetPendingStateChange(s, mainState);
+        if(next == XR_SESSION_STATE_UNKNOWN) {
+            return false;
+        }
+        s.sessionState = next;
+        return true;
+    });
+
+    if(!changed) {
+        return OptionalSessionStateChange { false, XR_SESSION_STATE_UNKNOWN };
+    }
+    return OptionalSessionStateChange { true, newState.sessionState };
+}
+
+#endif // _SESSION_STATE_H_
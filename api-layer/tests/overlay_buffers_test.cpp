@@ -0,0 +1,178 @@
+#include "overlay_buffers.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+
+TEST(SwapchainImageIndexRing, StartsEmpty)
+{
+    SwapchainImageIndexRing ring(3);
+    EXPECT_TRUE(ring.Empty());
+    EXPECT_FALSE(ring.Full());
+}
+
+TEST(SwapchainImageIndexRing, PopsInPushOrder)
+{
+    SwapchainImageIndexRing ring(3);
+    EXPECT_TRUE(ring.Push(2));
+    EXPECT_TRUE(ring.Push(0));
+    EXPECT_TRUE(ring.Push(1));
+    EXPECT_TRUE(ring.Full());
+
+    EXPECT_EQ(ring.Front(), 2u);
+    EXPECT_TRUE(ring.Pop());
+    EXPECT_EQ(ring.Front(), 0u);
+    EXPECT_TRUE(ring.Pop());
+    EXPECT_EQ(ring.Front(), 1u);
+    EXPECT_TRUE(ring.Pop());
+    EXPECT_TRUE(ring.Empty());
+}
+
+TEST(SwapchainImageIndexRing, WrapsAround)
+{
+    SwapchainImageIndexRing ring(3);
+    for(uint32_t i = 0; i < 10; i++) {
+        EXPECT_TRUE(ring.Push(i));
+        EXPECT_TRUE(ring.Push(i + 100));
+        EXPECT_EQ(ring.Front(), i);
+        EXPECT_TRUE(ring.Pop());
+        EXPECT_EQ(ring.Front(), i + 100);
+        EXPECT_TRUE(ring.Pop());
+        EXPECT_TRUE(ring.Empty());
+    }
+}
+
+TEST(SwapchainImageIndexRing, PushWhenFullFails)
+{
+    SwapchainImageIndexRing ring(2);
+    EXPECT_TRUE(ring.Push(0));
+    EXPECT_TRUE(ring.Push(1));
+    EXPECT_FALSE(ring.Push(2));
+    EXPECT_EQ(ring.Front(), 0u);
+    EXPECT_TRUE(ring.Pop());
+    EXPECT_EQ(ring.Front(), 1u);
+    EXPECT_TRUE(ring.Pop());
+    EXPECT_TRUE(ring.Empty());
+}
+
+TEST(SwapchainImageIndexRing, PopAndFrontWhenEmpty)
+{
+    SwapchainImageIndexRing ring(2);
+    EXPECT_EQ(ring.Front(), SwapchainImageIndexRing::noIndex);
+    EXPECT_FALSE(ring.Pop());
+    EXPECT_TRUE(ring.Empty());
+
+    EXPECT_TRUE(ring.Push(1));
+    EXPECT_TRUE(ring.Pop());
+    EXPECT_FALSE(ring.Pop());
+    EXPECT_TRUE(ring.Push(0));
+    EXPECT_EQ(ring.Front(), 0u);
+}
+
+TEST(SwapchainImageIndexRing, ZeroCapacity)
+{
+    SwapchainImageIndexRing ring(0);
+    EXPECT_TRUE(ring.Empty());
+    EXPECT_TRUE(ring.Full());
+    EXPECT_FALSE(ring.Push(0));
+    EXPECT_EQ(ring.Front(), SwapchainImageIndexRing::noIndex);
+    EXPECT_FALSE(ring.Pop());
+}
+
+TEST(TripleBuffer, NothingPublished)
+{
+    TripleBuffer<int> buffer;
+    bool fresh = true;
+    buffer.AcquireLatest(&fresh);
+    EXPECT_FALSE(fresh);
+}
+
+TEST(TripleBuffer, AcquiresLatestPublished)
+{
+    TripleBuffer<int> buffer;
+    bool fresh = false;
+
+    buffer.GetWriteBuffer() = 1;
+    buffer.Publish();
+    EXPECT_EQ(buffer.AcquireLatest(&fresh), 1);
+    EXPECT_TRUE(fresh);
+
+    // Same buffer again until something new is published
+    EXPECT_EQ(buffer.AcquireLatest(&fresh), 1);
+    EXPECT_FALSE(fresh);
+
+    buffer.GetWriteBuffer() = 2;
+    buffer.Publish();
+    buffer.GetWriteBuffer() = 3;
+    buffer.Publish();
+    EXPECT_EQ(buffer.AcquireLatest(&fresh), 3);
+    EXPECT_TRUE(fresh);
+}
+
+TEST(TripleBuffer, WriterNeverGetsReadersBuffer)
+{
+    TripleBuffer<int> buffer;
+    for(int i = 1; i < 20; i++) {
+        buffer.GetWriteBuffer() = i;
+        buffer.Publish();
+        const int& read = buffer.AcquireLatest();
+        EXPECT_EQ(read, i);
+        EXPECT_NE(&buffer.GetWriteBuffer(), &read);
+        // Publishing without the reader taking it must not disturb what it holds
+        buffer.GetWriteBuffer() = -i;
+        buffer.Publish();
+        EXPECT_EQ(read, i);
+        EXPECT_NE(&buffer.GetWriteBuffer(), &read);
+        EXPECT_EQ(buffer.AcquireLatest(), -i);
+    }
+}
+
+TEST(FrameTimingRing, ReadsInRecordOrder)
+{
+    auto ring = std::make_unique<FrameTimingRing>();
+    for(uint64_t frame = 0; frame < 5; frame++) {
+        ring->Record(XR_FRAME_TIMING_PHASE_WAIT_FRAME_EXTX, frame, frame * 10, 5, 2);
+    }
+
+    std::vector<XrFrameTimingEXTX> timings;
+    ring->Read(1234, timings);
+    ASSERT_EQ(timings.size(), 5u);
+    for(uint64_t frame = 0; frame < 5; frame++) {
+        const XrFrameTimingEXTX& timing = timings[frame];
+        EXPECT_EQ(timing.type, XR_TYPE_FRAME_TIMING_EXTX);
+        EXPECT_EQ(timing.overlayProcessId, 1234u);
+        EXPECT_EQ(timing.phase, XR_FRAME_TIMING_PHASE_WAIT_FRAME_EXTX);
+        EXPECT_EQ(timing.frameTickSequence, frame);
+        EXPECT_EQ(timing.start, (int64_t)frame * 10);
+        EXPECT_EQ(timing.duration, 5);
+        EXPECT_EQ(timing.downchainDuration, 2);
+    }
+}
+
+TEST(FrameTimingRing, KeepsOnlyMostRecent)
+{
+    auto ring = std::make_unique<FrameTimingRing>();
+    const uint64_t total = FrameTimingRing::recordCount + 100;
+    for(uint64_t frame = 0; frame < total; frame++) {
+        ring->Record(XR_FRAME_TIMING_PHASE_END_FRAME_EXTX, frame, 0, 0, 0);
+    }
+
+    std::vector<XrFrameTimingEXTX> timings;
+    ring->Read(0, timings);
+    ASSERT_EQ(timings.size(), (size_t)FrameTimingRing::recordCount);
+    EXPECT_EQ(timings.front().frameTickSequence, 100u);
+    EXPECT_EQ(timings.back().frameTickSequence, total - 1);
+}
+
+TEST(FrameTimingRing, ReadAppends)
+{
+    auto ring = std::make_unique<FrameTimingRing>();
+    std::vector<XrFrameTimingEXTX> timings;
+    ring->Read(0, timings);
+    EXPECT_TRUE(timings.empty());
+
+    ring->Record(XR_FRAME_TIMING_PHASE_BEGIN_FRAME_EXTX, 7, 0, 0, 0);
+    timings.resize(2);
+    ring->Read(0, timings);
+    ASSERT_EQ(timings.size(), 3u);
+    EXPECT_EQ(timings[2].frameTickSequence, 7u);
+}
@@ -0,0 +1,279 @@
+#include "session_state.h"
+
+#include <gtest/gtest.h>
+#include <iterator>
+#include <vector>
+
+std::atomic<uint64_t> gMainFrameTickSequence = 0;
+
+static const XrSessionState allStates[] = {
+    XR_SESSION_STATE_UNKNOWN,
+    XR_SESSION_STATE_IDLE,
+    XR_SESSION_STATE_READY,
+    XR_SESSION_STATE_SYNCHRONIZED,
+    XR_SESSION_STATE_VISIBLE,
+    XR_SESSION_STATE_FOCUSED,
+    XR_SESSION_STATE_STOPPING,
+    XR_SESSION_STATE_LOSS_PENDING,
+    XR_SESSION_STATE_EXITING,
+};
+
+static const OpenXRCommand allCommands[] = {
+    BEGIN_SESSION,
+    WAIT_FRAME,
+    END_SESSION,
+    REQUEST_EXIT_SESSION,
+};
+
+// Whether an overlay session in "state" has xrBeginSession in effect
+static bool IsRunningIn(XrSessionState state)
+{
+    return (state == XR_SESSION_STATE_SYNCHRONIZED) ||
+        (state == XR_SESSION_STATE_VISIBLE) ||
+        (state == XR_SESSION_STATE_FOCUSED) ||
+        (state == XR_SESSION_STATE_STOPPING);
+}
+
+static void SetState(SessionStateTracker& tracker, XrSessionState state, bool isRunning)
+{
+    tracker.Update([&](SessionStateWord& s){
+        s.sessionState = state;
+        s.isRunning = isRunning;
+        return true;
+    });
+}
+
+// Puts an overlay in "state", issues "command", and returns the change the
+// overlay is then given, or UNKNOWN if none
+static XrSessionState TransitionAfterCommand(XrSessionState state, OpenXRCommand command, MainSessionSessionState& main)
+{
+    SessionStateTracker overlay;
+    SetState(overlay, state, IsRunningIn(state));
+    overlay.DoCommand(command);
+
+    OptionalSessionStateChange change = overlay.GetAndDoPendingStateChange(&main);
+    if(!change.first) {
+        EXPECT_EQ(overlay.GetSessionState(), state);
+        return XR_SESSION_STATE_UNKNOWN;
+    }
+    EXPECT_EQ(overlay.GetSessionState(), change.second);
+    return change.second;
+}
+
+struct ExpectedTransition
+{
+    XrSessionState state;
+    XrSessionState afterCommand[4];     // indexed like allCommands; UNKNOWN is no change
+};
+
+TEST(SessionState, EveryStateAndCommandWithMainFocused)
+{
+    MainSessionSessionState main;
+    main.DoCommand(BEGIN_SESSION);
+    main.DoStateChange(XR_SESSION_STATE_FOCUSED, 0);
+
+    const XrSessionState none = XR_SESSION_STATE_UNKNOWN;
+    const ExpectedTransition expected[] = {
+        //                               BEGIN_SESSION                  WAIT_FRAME                     END_SESSION                    REQUEST_EXIT_SESSION
+        { XR_SESSION_STATE_UNKNOWN,      { XR_SESSION_STATE_IDLE,        XR_SESSION_STATE_IDLE,         XR_SESSION_STATE_IDLE,         XR_SESSION_STATE_IDLE } },
+        { XR_SESSION_STATE_IDLE,         { XR_SESSION_STATE_READY,       XR_SESSION_STATE_READY,        XR_SESSION_STATE_READY,        XR_SESSION_STATE_EXITING } },
+        { XR_SESSION_STATE_READY,        { XR_SESSION_STATE_SYNCHRONIZED, none,                         none,                          none } },
+        { XR_SESSION_STATE_SYNCHRONIZED, { XR_SESSION_STATE_VISIBLE,     XR_SESSION_STATE_VISIBLE,      XR_SESSION_STATE_VISIBLE,      XR_SESSION_STATE_STOPPING } },
+        { XR_SESSION_STATE_VISIBLE,      { XR_SESSION_STATE_FOCUSED,     XR_SESSION_STATE_FOCUSED,      XR_SESSION_STATE_FOCUSED,      XR_SESSION_STATE_SYNCHRONIZED } },
+        { XR_SESSION_STATE_FOCUSED,      { none,                         none,                          none,                          XR_SESSION_STATE_VISIBLE } },
+        { XR_SESSION_STATE_STOPPING,     { none,                         none,                          XR_SESSION_STATE_IDLE,         none } },
+        { XR_SESSION_STATE_LOSS_PENDING, { none,                         none,                          none,                          none } },
+        { XR_SESSION_STATE_EXITING,      { none,                         none,                          none,                          none } },
+    };
+
+    ASSERT_EQ(std::size(expected), std::size(allStates));
+    for(const auto& row : expected) {
+        for(size_t c = 0; c < std::size(allCommands); c++) {
+            SCOPED_TRACE(testing::Message() << "state " << row.state << " command " << allCommands[c]);
+            EXPECT_EQ(TransitionAfterCommand(row.state, allCommands[c], main), row.afterCommand[c]);
+        }
+    }
+}
+
+TEST(SessionState, EveryStateAndCommandWithMainStopping)
+{
+    MainSessionSessionState main;
+    main.DoCommand(BEGIN_SESSION);
+    main.DoStateChange(XR_SESSION_STATE_STOPPING, 0);
+
+    const XrSessionState none = XR_SESSION_STATE_UNKNOWN;
+    const ExpectedTransition expected[] = {
+        //                               BEGIN_SESSION                  WAIT_FRAME                     END_SESSION                    REQUEST_EXIT_SESSION
+        { XR_SESSION_STATE_UNKNOWN,      { XR_SESSION_STATE_IDLE,        XR_SESSION_STATE_IDLE,         XR_SESSION_STATE_IDLE,         XR_SESSION_STATE_IDLE } },
+        { XR_SESSION_STATE_IDLE,         { XR_SESSION_STATE_READY,       XR_SESSION_STATE_READY,        XR_SESSION_STATE_READY,        XR_SESSION_STATE_EXITING } },
+        { XR_SESSION_STATE_READY,        { XR_SESSION_STATE_SYNCHRONIZED, none,                         none,                          none } },
+        { XR_SESSION_STATE_SYNCHRONIZED, { XR_SESSION_STATE_STOPPING,    XR_SESSION_STATE_STOPPING,     XR_SESSION_STATE_STOPPING,     XR_SESSION_STATE_STOPPING } },
+        { XR_SESSION_STATE_VISIBLE,      { XR_SESSION_STATE_SYNCHRONIZED, XR_SESSION_STATE_SYNCHRONIZED, XR_SESSION_STATE_SYNCHRONIZED, XR_SESSION_STATE_SYNCHRONIZED } },
+        { XR_SESSION_STATE_FOCUSED,      { XR_SESSION_STATE_VISIBLE,     XR_SESSION_STATE_VISIBLE,      XR_SESSION_STATE_VISIBLE,      XR_SESSION_STATE_VISIBLE } },
+        { XR_SESSION_STATE_STOPPING,     { none,                         none,                          XR_SESSION_STATE_IDLE,         none } },
+        { XR_SESSION_STATE_LOSS_PENDING, { none,                         none,                          none,                          none } },
+        { XR_SESSION_STATE_EXITING,      { none,                         none,                          none,                          none } },
+    };
+
+    ASSERT_EQ(std::size(expected), std::size(allStates));
+    for(const auto& row : expected) {
+        for(size_t c = 0; c < std::size(allCommands); c++) {
+            SCOPED_TRACE(testing::Message() << "state " << row.state << " command " << allCommands[c]);
+            EXPECT_EQ(TransitionAfterCommand(row.state, allCommands[c], main), row.afterCommand[c]);
+        }
+    }
+}
+
+TEST(SessionState, EveryStateAndCommandWithMainNotStarted)
+{
+    MainSessionSessionState main;
+
+    // Main isn't running, so a running overlay winds down; otherwise only the
+    // overlay's own commands move it
+    for(XrSessionState state : allStates) {
+        for(OpenXRCommand command : allCommands) {
+            SCOPED_TRACE(testing::Message() << "state " << state << " command " << command);
+            XrSessionState next = TransitionAfterCommand(state, command, main);
+            if(state == XR_SESSION_STATE_READY && command == BEGIN_SESSION) {
+                EXPECT_EQ(next, XR_SESSION_STATE_SYNCHRONIZED);
+            } else if(state == XR_SESSION_STATE_STOPPING && command == END_SESSION) {
+                EXPECT_EQ(next, XR_SESSION_STATE_IDLE);
+            } else if(state == XR_SESSION_STATE_IDLE && command == REQUEST_EXIT_SESSION) {
+                EXPECT_EQ(next, XR_SESSION_STATE_EXITING);
+            } else if(state == XR_SESSION_STATE_SYNCHRONIZED) {
+                EXPECT_EQ(next, XR_SESSION_STATE_STOPPING);
+            } else if(state == XR_SESSION_STATE_VISIBLE) {
+                EXPECT_EQ(next, XR_SESSION_STATE_SYNCHRONIZED);
+            } else if(state == XR_SESSION_STATE_FOCUSED) {
+                EXPECT_EQ(next, XR_SESSION_STATE_VISIBLE);
+            } else {
+                EXPECT_EQ(next, XR_SESSION_STATE_UNKNOWN);
+            }
+        }
+    }
+}
+
+TEST(SessionState, MainLossMovesEveryStateToLossPending)
+{
+    MainSessionSessionState main;
+    main.DoCommand(BEGIN_SESSION);
+    main.DoStateChange(XR_SESSION_STATE_FOCUSED, 0);
+    main.DoSessionLost();
+
+    for(XrSessionState state : allStates) {
+        for(OpenXRCommand command : allCommands) {
+            SCOPED_TRACE(testing::Message() << "state " << state << " command " << command);
+            XrSessionState expected = (state == XR_SESSION_STATE_LOSS_PENDING) ? XR_SESSION_STATE_UNKNOWN : XR_SESSION_STATE_LOSS_PENDING;
+            EXPECT_EQ(TransitionAfterCommand(state, command, main), expected);
+        }
+    }
+}
+
+TEST(SessionState, OverlayLifecycleFollowsMain)
+{
+    MainSessionSessionState main;
+    SessionStateTracker overlay;
+    std::vector<XrSessionState> changes;
+    auto drain = [&]{
+        while(1) {
+            OptionalSessionStateChange change = overlay.GetAndDoPendingStateChange(&main);
+            if(!change.first) {
+                break;
+            }
+            changes.push_back(change.second);
+        }
+    };
+
+    main.DoStateChange(XR_SESSION_STATE_IDLE, 0);
+    drain();
+    main.DoStateChange(XR_SESSION_STATE_READY, 0);
+    main.DoCommand(BEGIN_SESSION);
+    drain();
+    overlay.DoCommand(BEGIN_SESSION);
+    drain();
+    main.DoStateChange(XR_SESSION_STATE_SYNCHRONIZED, 0);
+    main.DoStateChange(XR_SESSION_STATE_VISIBLE, 0);
+    main.DoStateChange(XR_SESSION_STATE_FOCUSED, 0);
+    drain();
+    EXPECT_TRUE(overlay.IsVisible());
+    EXPECT_TRUE(overlay.IsFocused());
+
+    overlay.DoCommand(REQUEST_EXIT_SESSION);
+    drain();
+    EXPECT_FALSE(overlay.IsVisible());
+    overlay.DoCommand(END_SESSION);
+    drain();
+
+    const std::vector<XrSessionState> expected = {
+        XR_SESSION_STATE_IDLE,
+        XR_SESSION_STATE_READY,
+        XR_SESSION_STATE_SYNCHRONIZED,
+        XR_SESSION_STATE_VISIBLE,
+        XR_SESSION_STATE_FOCUSED,
+        XR_SESSION_STATE_VISIBLE,
+        XR_SESSION_STATE_SYNCHRONIZED,
+        XR_SESSION_STATE_STOPPING,
+        XR_SESSION_STATE_IDLE,
+        XR_SESSION_STATE_EXITING,
+    };
+    EXPECT_EQ(changes, expected);
+    EXPECT_FALSE(overlay.IsRunning());
+}
+
+TEST(SessionState, MainBeginSessionCountsAsWaitFrame)
+{
+    MainSessionSessionState main;
+    main.DoCommand(WAIT_FRAME);
+    EXPECT_FALSE(main.Load().hasCalledWaitFrame);
+    EXPECT_FALSE(main.IsRunning());
+    main.DoCommand(BEGIN_SESSION);
+    EXPECT_TRUE(main.Load().hasCalledWaitFrame);
+    EXPECT_TRUE(main.IsRunning());
+    main.DoCommand(END_SESSION);
+    EXPECT_FALSE(main.IsRunning());
+}
+
+TEST(SessionStateWord, PackUnpackRoundTrip)
+{
+    const SessionLossState allLossStates[] = { NOT_LOST, LOSS_PENDING, LOST };
+
+    for(XrSessionState state : allStates) {
+        for(SessionLossState loss : allLossStates) {
+            for(uint32_t flags = 0; flags < 8; flags++) {
+                SessionStateWord s;
+                s.sessionState = state;
+                s.lossState = loss;
+                s.isRunning = (flags & 1) != 0;
+                s.exitRequested = (flags & 2) != 0;
+                s.hasCalledWaitFrame = (flags & 4) != 0;
+
+                SCOPED_TRACE(testing::Message() << "state " << state << " loss " << loss << " flags " << flags);
+                uint64_t word = s.Pack();
+                SessionStateWord u = SessionStateWord::Unpack(word);
+                EXPECT_EQ(u.sessionState, s.sessionState);
+                EXPECT_EQ(u.lossState, s.lossState);
+                EXPECT_EQ(u.isRunning, s.isRunning);
+                EXPECT_EQ(u.exitRequested, s.exitRequested);
+                EXPECT_EQ(u.hasCalledWaitFrame, s.hasCalledWaitFrame);
+                EXPECT_EQ(u.Pack(), word);
+
+                bool visible = (state == XR_SESSION_STATE_VISIBLE) || (state == XR_SESSION_STATE_FOCUSED);
+                EXPECT_EQ((word & SessionStateWord::VISIBLE_BIT) != 0, visible);
+                EXPECT_EQ((word & SessionStateWord::FOCUSED_BIT) != 0, state == XR_SESSION_STATE_FOCUSED);
+            }
+        }
+    }
+}
+
+TEST(SessionStateWord, DefaultIsUnknownAndStopped)
+{
+    SessionStateTracker tracker;
+    EXPECT_EQ(tracker.GetSessionState(), XR_SESSION_STATE_UNKNOWN);
+    EXPECT_EQ(tracker.GetLossState(), NOT_LOST);
+    EXPECT_FALSE(tracker.IsRunning());
+    EXPECT_FALSE(tracker.IsVisible());
+    EXPECT_FALSE(tracker.IsFocused());
+
+    tracker.DoSessionLost();
+    EXPECT_EQ(tracker.GetLossState(), LOST);
+}
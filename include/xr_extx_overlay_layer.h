@@ -0,0 +1,157 @@
+#ifndef _XR_EXTX_OVERLAY_LAYER_H_
+#define _XR_EXTX_OVERLAY_LAYER_H_
+
+// Structures the overlay API layer understands in addition to XR_EXTX_overlay.
+// These are not in the OpenXR registry; generate.py adds them to the set of
+// structures it knows how to copy, serialize, and substitute handles in.
+// Structure type values are taken from the unused part of XR_EXTX_overlay's range.
+
+#include <openxr/openxr.h>
+
+// Chain to an XrCompositionLayerQuad submitted by an overlay.  Instead of
+// using the layer's pose as submitted, Main locates "space" in the layer's
+// space at Main's xrEndFrame displayTime and uses that location composed with
+// "pose".  Panels attached to tracked spaces then don't lag by the overlay's
+// frame latency.
+#define XR_TYPE_COMPOSITION_LAYER_LATE_LATCH_EXTX ((XrStructureType)1000033100)
+typedef struct XrCompositionLayerLateLatchEXTX {
+    XrStructureType             type;
+    const void* XR_MAY_ALIAS    next;
+    XrSpace                     space;
+    XrPosef                     pose;
+} XrCompositionLayerLateLatchEXTX;
+
+// Chain to XrSessionCreateInfoOverlayEXTX to choose what Main does with an
+// overlay's last submitted layers when the overlay hasn't submitted new ones
+// for more than staleFrameLimit of Main's frames.  Without this, layers are
+// reused indefinitely.
+typedef enum XrOverlayStaleLayerPolicyEXTX {
+    XR_OVERLAY_STALE_LAYER_POLICY_REUSE_EXTX = 0,   // keep submitting them
+    XR_OVERLAY_STALE_LAYER_POLICY_FADE_EXTX = 1,    // fade out over another staleFrameLimit frames, then drop
+    XR_OVERLAY_STALE_LAYER_POLICY_DROP_EXTX = 2,    // stop submitting them
+    XR_OVERLAY_STALE_LAYER_POLICY_MAX_ENUM_EXTX = 0x7FFFFFFF
+} XrOverlayStaleLayerPolicyEXTX;
+
+#define XR_TYPE_OVERLAY_STALE_LAYER_POLICY_INFO_EXTX ((XrStructureType)1000033101)
+typedef struct XrOverlayStaleLayerPolicyInfoEXTX {
+    XrStructureType                 type;
+    const void* XR_MAY_ALIAS        next;
+    XrOverlayStaleLayerPolicyEXTX   policy;
+    uint32_t                        staleFrameLimit;
+} XrOverlayStaleLayerPolicyInfoEXTX;
+
+// Chain to XrSessionCreateInfoOverlayEXTX to rank this overlay when all
+// overlays' layers together exceed the runtime's maxLayerCount.  Overlays with
+// higher importance (then higher sessionLayersPlacement) keep their layers;
+// the rest are left out of that frame.  Default importance is 0.
+#define XR_TYPE_OVERLAY_SESSION_PRIORITY_INFO_EXTX ((XrStructureType)1000033103)
+typedef struct XrOverlaySessionPriorityInfoEXTX {
+    XrStructureType             type;
+    const void* XR_MAY_ALIAS    next;
+    uint32_t                    importance;
+} XrOverlaySessionPriorityInfoEXTX;
+
+// Chain to XrSessionCreateInfoOverlayEXTX to ask for new frames only every
+// frameInterval of Main's frames.  Chain to XrFrameEndInfo to change the
+// interval later, e.g. while content is animating.  A blocking xrWaitFrame
+// then waits out the frames in between; a relaxed one reports shouldRender
+// false for them.  Main keeps submitting the last layers meanwhile, and they
+// don't count as stale.  0 and 1 both mean every frame.
+#define XR_TYPE_OVERLAY_UPDATE_RATE_INFO_EXTX ((XrStructureType)1000033104)
+typedef struct XrOverlayUpdateRateInfoEXTX {
+    XrStructureType             type;
+    const void* XR_MAY_ALIAS    next;
+    uint32_t                    frameInterval;
+} XrOverlayUpdateRateInfoEXTX;
+
+// Chain to an overlay's XrSessionCreateInfo in place of a graphics API binding
+// to render swapchain images on the CPU.  xrEnumerateSwapchainImages then
+// returns XrSwapchainImageCpuEXTX pointing at memory shared with Main, which
+// uploads each released image into its own swapchain.  Formats are
+// DXGI_FORMATs, as with D3D11; only uncompressed ones are supported.
+#define XR_TYPE_GRAPHICS_BINDING_CPU_EXTX ((XrStructureType)1000033106)
+typedef struct XrGraphicsBindingCpuEXTX {
+    XrStructureType             type;
+    const void* XR_MAY_ALIAS    next;
+} XrGraphicsBindingCpuEXTX;
+
+#define XR_TYPE_SWAPCHAIN_IMAGE_CPU_EXTX ((XrStructureType)1000033107)
+typedef struct XrSwapchainImageCpuEXTX {
+    XrStructureType             type;
+    void* XR_MAY_ALIAS          next;
+    void*                       pixels;                 // only valid between xrWaitSwapchainImage and xrReleaseSwapchainImage
+    uint32_t                    rowPitch;
+} XrSwapchainImageCpuEXTX;
+
+// Chain to an overlay's XrSwapchainImageReleaseInfo to say that only "rects"
+// of the image differ from the image released before it on this swapchain;
+// the rest must be unchanged.  Main then copies only those rectangles (and
+// any its own image missed while other images were in use) instead of the
+// whole image.  rectCount 0 means nothing changed.
+#define XR_TYPE_SWAPCHAIN_IMAGE_DIRTY_RECTS_EXTX ((XrStructureType)1000033108)
+typedef struct XrSwapchainImageDirtyRectsEXTX {
+    XrStructureType             type;
+    const void* XR_MAY_ALIAS    next;
+    uint32_t                    rectCount;
+    const XrRect2Di*            rects;
+} XrSwapchainImageDirtyRectsEXTX;
+
+// An overlay whose swapchain contents haven't changed may skip
+// xrAcquireSwapchainImage, xrWaitSwapchainImage, and xrReleaseSwapchainImage
+// for that swapchain and submit it as before; Main then shows the runtime
+// image it last copied into, with no RPCs or copies for it.
+// XrOverlayStatsEXTX::staticFrames counts frames where every swapchain did so.
+
+// Per-overlay counters, read in the main application's process with
+// xrEnumerateOverlayStatsEXTX (from xrGetInstanceProcAddr on Main's XrInstance).
+#define XR_TYPE_OVERLAY_STATS_EXTX ((XrStructureType)1000033102)
+typedef struct XrOverlayStatsEXTX {
+    XrStructureType             type;
+    void* XR_MAY_ALIAS          next;
+    uint32_t                    overlayProcessId;
+    uint32_t                    sessionLayersPlacement;
+    XrOverlayStaleLayerPolicyEXTX stalePolicy;
+    uint32_t                    importance;
+    uint32_t                    frameInterval;
+    uint64_t                    submittedFrames;        // overlay xrEndFrames
+    uint64_t                    staticFrames;           // of those, ones that released no image of a swapchain they showed
+    uint64_t                    staleFrames;            // Main frames past frameInterval that found no new submission
+    uint64_t                    droppedFrames;          // Main frames that withheld layers because of stalePolicy
+    uint64_t                    culledFrames;           // Main frames that withheld layers to fit maxLayerCount
+    uint64_t                    stalledFrames;          // Main frames that withheld layers because Main couldn't take a released image
+    XrDuration                  lastSubmitLatency;      // overlay xrEndFrame to the Main xrEndFrame first submitting it
+    XrDuration                  maxSubmitLatency;
+} XrOverlayStatsEXTX;
+
+typedef XrResult (XRAPI_PTR *PFN_xrEnumerateOverlayStatsEXTX)(XrInstance instance, uint32_t statsCapacityInput, uint32_t* statsCountOutput, XrOverlayStatsEXTX* stats);
+
+// Recent xrWaitFrame, xrBeginFrame, and xrEndFrame calls, recorded in the main
+// application's process for Main's session and for each overlay's calls as
+// they arrive there, so all times are on one clock (steady clock nanoseconds
+// in Main's process).  Read with xrEnumerateFrameTimingsEXTX, or written to a
+// file with xrDumpFrameTimingsEXTX, from xrGetInstanceProcAddr on Main's XrInstance.
+typedef enum XrFrameTimingPhaseEXTX {
+    XR_FRAME_TIMING_PHASE_WAIT_FRAME_EXTX = 0,
+    XR_FRAME_TIMING_PHASE_BEGIN_FRAME_EXTX = 1,
+    XR_FRAME_TIMING_PHASE_END_FRAME_EXTX = 2,
+    XR_FRAME_TIMING_PHASE_MAX_ENUM_EXTX = 0x7FFFFFFF
+} XrFrameTimingPhaseEXTX;
+
+#define XR_TYPE_FRAME_TIMING_EXTX ((XrStructureType)1000033105)
+typedef struct XrFrameTimingEXTX {
+    XrStructureType             type;
+    void* XR_MAY_ALIAS          next;
+    uint32_t                    overlayProcessId;       // 0 for Main's own session
+    XrFrameTimingPhaseEXTX      phase;
+    uint64_t                    frameTickSequence;      // Main xrWaitFrames completed when the call returned
+    XrDuration                  start;
+    XrDuration                  duration;               // entry to return
+    XrDuration                  downchainDuration;      // part of duration in the runtime, or blocked on Main's frame
+} XrFrameTimingEXTX;
+
+typedef XrResult (XRAPI_PTR *PFN_xrEnumerateFrameTimingsEXTX)(XrInstance instance, uint32_t timingCapacityInput, uint32_t* timingCountOutput, XrFrameTimingEXTX* timings);
+
+// Writes every recorded timing to "path", as JSON if it ends in ".json" and CSV otherwise
+typedef XrResult (XRAPI_PTR *PFN_xrDumpFrameTimingsEXTX)(XrInstance instance, const char* path);
+
+#endif /* _XR_EXTX_OVERLAY_LAYER_H_ */